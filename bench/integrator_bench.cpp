@@ -0,0 +1,194 @@
+#include "physics_manager.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Compares the spring integrators on a field of emu-shaped ragdolls falling freely, high above
+ * the arena so no contacts or ground collisions disturb the energy. Each ragdoll starts
+ * stretched, so its springs oscillate while it falls. Prints steps per second and the drift of
+ * total energy (kinetic, gravitational and spring) over the run for every configuration, as a
+ * fraction of the spring energy at the start.
+ *
+ * Then swings a stiff chain from a fixed end with each integrator and prints how far its springs
+ * strayed from their rest lengths, to show which integrators hold stiff springs.
+ *
+ * Usage: integrator_bench [ragdolls] [seconds]
+ */
+
+// Match PhysicsManager: gravity is a force per step, independent of mass
+const float GRAVITY_STRENGTH = 0.005f;
+const float STEPS_PER_SECOND = 60;
+
+const float START_HEIGHT = 5000.0f;
+const float SPACING = 20.0f;
+const float INITIAL_STRETCH = 1.3f;
+
+struct Ragdoll {
+    std::vector<Particle*> particles;
+    std::vector<float> masses;
+    std::vector<Spring*> springs;
+};
+
+/**
+ * Same layout, masses and spring constants as Emu, scaled out by INITIAL_STRETCH.
+ */
+void addRagdoll(PhysicsManager &pm, Ragdoll &world, vec3 origin, float stiffnessScale, bool isDamped) {
+    const vec3 offsets[] = {
+        vec3(0, 0, 0), vec3(0, 4, 0), vec3(0, 7, 0), vec3(1, 0, 0), vec3(-1, 0, 0),
+        vec3(1, 2, 0), vec3(-1, 2, 0), vec3(0, 5, 0), vec3(0, 6, 0)
+    };
+    const float masses[] = { 1, 1, 1, 1, 1, 1, 1, 2, 2 };
+    const float radii[] = { 0.4f, 1, 0.5f, 0.4f, 0.4f, 0.2f, 0.2f, 0.2f, 0.2f };
+
+    int first = world.particles.size();
+    for (int i = 0; i < 9; i++) {
+        Particle *p = new Particle(nullptr, 0, origin + offsets[i] * INITIAL_STRETCH, masses[i], radii[i]);
+        pm.addParticle(p, false);
+        world.particles.push_back(p);
+        world.masses.push_back(masses[i]);
+    }
+
+    struct { int p1, p2; float length, stiffness, damping; } layout[] = {
+        { 0, 1, 3, 0.08f, 0.01f },
+        { 1, 5, 1.5f, 0.2f, 0.2f }, { 1, 6, 1.5f, 0.2f, 0.2f },
+        { 5, 3, 1.5f, 0.2f, 0.2f }, { 6, 4, 1.5f, 0.2f, 0.2f },
+        { 1, 7, 0.6f, 0.2f, 0.2f }, { 7, 8, 0.6f, 0.2f, 0.2f }, { 8, 2, 0.6f, 0.2f, 0.2f }
+    };
+    for (int s = 0; s < 8; s++) {
+        Spring *spring = new Spring(world.particles[first + layout[s].p1], world.particles[first + layout[s].p2],
+                                    layout[s].length, layout[s].stiffness * stiffnessScale,
+                                    isDamped ? layout[s].damping : 0);
+        pm.addSpring(spring, false);
+        world.springs.push_back(spring);
+    }
+}
+
+double springEnergy(const Ragdoll &world) {
+    double energy = 0;
+    for (int i = 0; i < world.springs.size(); i++) {
+        Spring *s = world.springs[i];
+        double stretch = length(s->getParticle1()->getPosition() - s->getParticle2()->getPosition()) - s->getTargetLength();
+        energy += 0.5 * s->getStiffness() * stretch * stretch;
+    }
+    return energy;
+}
+
+double totalEnergy(const Ragdoll &world) {
+    double energy = springEnergy(world);
+    for (int i = 0; i < world.particles.size(); i++) {
+        Particle *p = world.particles[i];
+        vec3 v = p->getVelocity();
+        energy += 0.5 * world.masses[i] * dot(v, v) + GRAVITY_STRENGTH * p->getPosition().y;
+    }
+    return energy;
+}
+
+/**
+ * Simulate the given number of seconds of game time with steps of h 60 Hz steps each.
+ */
+void run(const char *name, PhysicsManager::Integrator integrator, float h, int ragdolls, float seconds,
+         float stiffnessScale, bool isDamped) {
+    PhysicsManager pm;
+    pm.setSleepThreshold(0, 0);
+    pm.setIntegrator(integrator, 8);
+
+    Ragdoll world;
+    int side = 1;
+    while (side * side < ragdolls) side++;
+    for (int i = 0; i < ragdolls; i++) {
+        vec3 origin((i % side) * SPACING, START_HEIGHT, (i / side) * SPACING);
+        addRagdoll(pm, world, origin, stiffnessScale, isDamped);
+    }
+
+    int steps = (int) (seconds * STEPS_PER_SECOND / h);
+    double startEnergy = totalEnergy(world);
+    double startSpringEnergy = springEnergy(world);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        pm.update(h / STEPS_PER_SECOND);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double drift = (totalEnergy(world) - startEnergy) / startSpringEnergy;
+    printf("%-10s %6.1f %5s %8.1f %12.0f ", name, stiffnessScale, isDamped ? "yes" : "no", h, steps / elapsed);
+    if (std::isfinite(drift)) printf("%14.3e\n", drift);
+    else printf("%14s\n", "diverged");
+}
+
+/**
+ * Largest difference between a spring's length and its rest length.
+ */
+double lengthError(const std::vector<Spring*> &springs) {
+    double error = 0;
+    for (int i = 0; i < springs.size(); i++) {
+        Spring *s = springs[i];
+        double stretch = fabs(length(s->getParticle1()->getPosition() - s->getParticle2()->getPosition()) - s->getTargetLength());
+        if (!(stretch <= error)) error = stretch;
+    }
+    return error;
+}
+
+/**
+ * Hang a chain of eight unit springs of the given stiffness from a fixed particle and let it
+ * swing down from horizontal for the given number of seconds. Prints the largest length error
+ * seen after any step and the error at the end, when the chain hangs still. Even a perfect
+ * solver sags under load at the end: the top spring carries eight particles, so it stretches
+ * by 8 * GRAVITY_STRENGTH / stiffness.
+ */
+void runChain(const char *name, PhysicsManager::Integrator integrator, float h, float seconds, float stiffness) {
+    PhysicsManager pm;
+    pm.setSleepThreshold(0, 0);
+    pm.setIntegrator(integrator, 8);
+
+    std::vector<Spring*> springs;
+    Particle *previous = new Particle(nullptr, 0, vec3(0, START_HEIGHT, 0), 1, 0.1f, 0.99f, true);
+    pm.addParticle(previous, false);
+    for (int i = 1; i <= 8; i++) {
+        Particle *p = new Particle(nullptr, 0, vec3(i, START_HEIGHT, 0), 1, 0.1f);
+        pm.addParticle(p, false);
+        Spring *spring = new Spring(previous, p, 1, stiffness, 0.2f);
+        pm.addSpring(spring, false);
+        springs.push_back(spring);
+        previous = p;
+    }
+
+    int steps = (int) (seconds * STEPS_PER_SECOND / h);
+    double maxError = 0;
+    for (int i = 0; i < steps && std::isfinite(maxError); i++) {
+        pm.update(h / STEPS_PER_SECOND);
+        double error = lengthError(springs);
+        if (!(error <= maxError)) maxError = error;
+    }
+
+    printf("%-10s %6.1f %8.1f ", name, stiffness, h);
+    if (std::isfinite(maxError)) printf("%14.3e %14.3e %14.3e\n", maxError, lengthError(springs), 8 * GRAVITY_STRENGTH / stiffness);
+    else printf("%14s\n", "diverged");
+}
+
+int main(int argc, char **argv) {
+    int ragdolls = argc > 1 ? atoi(argv[1]) : 1000;
+    float seconds = argc > 2 ? atof(argv[2]) : 10;
+
+    printf("%d ragdolls, %.0f s of game time\n", ragdolls, seconds);
+    printf("%-10s %6s %5s %8s %12s %14s\n", "integrator", "k", "damp", "h", "steps/sec", "energy drift");
+
+    const float stiffnessScales[] = { 1, 10 };
+    for (int k = 0; k < 2; k++) {
+        for (int damped = 0; damped < 2; damped++) {
+            run("explicit", PhysicsManager::EXPLICIT, 1, ragdolls, seconds, stiffnessScales[k], damped);
+            run("implicit", PhysicsManager::IMPLICIT, 1, ragdolls, seconds, stiffnessScales[k], damped);
+            run("implicit", PhysicsManager::IMPLICIT, 4, ragdolls, seconds, stiffnessScales[k], damped);
+        }
+    }
+
+    printf("\nchain of 8 unit springs swinging from a fixed end, %.0f s of game time\n", seconds);
+    printf("%-10s %6s %8s %14s %14s %14s\n", "integrator", "k", "h", "peak error", "final error", "sag");
+    runChain("explicit", PhysicsManager::EXPLICIT, 1, seconds, 5);
+    runChain("pbd", PhysicsManager::POSITION_BASED, 1, seconds, 5);
+    runChain("implicit", PhysicsManager::IMPLICIT, 1, seconds, 5);
+}
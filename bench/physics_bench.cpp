@@ -0,0 +1,499 @@
+#include "physics_manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Headless physics scaling benchmark. Builds synthetic worlds of centipede-like chains,
+ * emu-like legged rigs and loose particle clouds, steps them and reports the mean time per step
+ * of each physics phase, along with the mean candidate pairs, contacts and active particles per
+ * step, as CSV or JSON. Like the arena, worlds are flat slabs that grow sideways with the
+ * particle count at constant density, or crowd around a player at the centre as enemies do in
+ * the game. They start high above the arena and fall freely, so the cost per particle stays
+ * comparable between sizes.
+ *
+ * Usage: sproin_physics_bench [options]
+ *   --world chains|rigs|cloud|mixed   world to build (default mixed)
+ *   --layout slab|cluster             spread bodies evenly, or cluster them around the centre
+ *                                     with the density falling off with distance (default slab)
+ *   --churn N                         remove N loose particles and spawn N new ones before
+ *                                     every step, like enemies dying and respawning (default 0)
+ *   --sizes 100,1000,...              particle counts (default 100 to 1000000, powers of ten)
+ *   --steps N                         timed steps per size (default scales with the size)
+ *   --warmup N                        untimed steps before timing (default 10)
+ *   --workers N                       worker threads besides the caller (default all cores)
+ *   --broadphase grid|sap             broadphase (default grid)
+ *   --integrator explicit|pbd|implicit
+ *   --format csv|json                 output format (default csv)
+ *   --lod                             enable level of detail, focused on the first particle so
+ *                                     that the far side of large worlds steps less often
+ *   --check-determinism               run each size with 0, 1, 3 and 7 workers in deterministic
+ *                                     mode and compare state hashes (default 6000 particles,
+ *                                     10000 steps); exits with 1 on a mismatch, or if the world
+ *                                     never had enough pairs or springs to go parallel
+ *   --check-broadphase                run each size with the grid and with sweep and prune,
+ *                                     churning loose particles between steps (default 2000
+ *                                     particles, 1000 steps, churn 10; use --world cloud), and
+ *                                     compare state hashes; exits with 1 on a mismatch
+ */
+
+struct Options {
+    std::string world = "mixed";
+    bool isClustered = false;
+    int churn = 0;
+    std::vector<int> sizes;
+    int steps = 0;
+    int warmup = 10;
+    int workers = -1;
+    Broadphase::Type broadphase = Broadphase::SPATIAL_HASH;
+    PhysicsManager::Integrator integrator = PhysicsManager::EXPLICIT;
+    const char *integratorName = "explicit";
+    bool isJson = false;
+    bool isDeterminismCheck = false;
+    bool isBroadphaseCheck = false;
+    bool isLod = false;
+};
+
+struct Result {
+    int particles = 0;
+    int springs = 0;
+    int steps = 0;
+    long long candidatePairs = 0;
+    long long contacts = 0;
+    long long activeParticles = 0;
+    PhysicsStats total;
+};
+
+const float START_HEIGHT = 10000.0f;
+const float SLAB_HEIGHT = 10.0f;
+
+// Roughly one particle per this many cubic units, as in a busy arena
+const float VOLUME_PER_PARTICLE = 27.0f;
+
+/**
+ * Deterministic generator so every run builds the same world.
+ */
+class Random {
+public:
+    Random(unsigned int seed)
+        : state(seed) { }
+
+    float next() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    }
+
+private:
+    unsigned int state;
+};
+
+/**
+ * Builds worlds inside a slab sized for the requested particle count.
+ */
+class WorldBuilder {
+public:
+    WorldBuilder(PhysicsManager &pm, int particleCount, bool isClustered)
+        : pm(pm)
+        , random(12345)
+        , isClustered(isClustered) {
+        side = sqrtf(particleCount * VOLUME_PER_PARTICLE / SLAB_HEIGHT);
+    }
+
+    void addChain() {
+        const int SEGMENTS = 6;
+        vec3 origin = randomOrigin();
+        vec3 direction = randomDirection();
+
+        Particle *previous = nullptr;
+        for (int i = 0; i < SEGMENTS; i++) {
+            Particle *p = new Particle(nullptr, 1, origin + direction * 2.5f * i, 1, 0.8, 0.95);
+            pm.addParticle(p, false);
+            particles.push_back(p);
+            if (previous != nullptr) addSpring(previous, p, 2.5, 0.01, 0.001);
+            previous = p;
+        }
+    }
+
+    void addRig() {
+        vec3 origin = randomOrigin();
+        Particle *base = addParticle(origin, 1, 0.4);
+        Particle *torso = addParticle(origin + vec3(0, 4, 0), 1, 1);
+        Particle *head = addParticle(origin + vec3(0, 7, 0), 1, 0.5);
+        Particle *leftKnee = addParticle(origin + vec3(1, 2, 0), 1, 0.2);
+        Particle *rightKnee = addParticle(origin + vec3(-1, 2, 0), 1, 0.2);
+        Particle *leftFoot = addParticle(origin + vec3(1, 0, 0), 1, 0.4);
+        Particle *rightFoot = addParticle(origin + vec3(-1, 0, 0), 1, 0.4);
+        Particle *neck1 = addParticle(origin + vec3(0, 5, 0), 2, 0.2);
+        Particle *neck2 = addParticle(origin + vec3(0, 6, 0), 2, 0.2);
+
+        addSpring(base, torso, 3, 0.08, 0.01);
+        addSpring(torso, leftKnee, 1.5, 0.2, 0.2);
+        addSpring(torso, rightKnee, 1.5, 0.2, 0.2);
+        addSpring(leftKnee, leftFoot, 1.5, 0.2, 0.2);
+        addSpring(rightKnee, rightFoot, 1.5, 0.2, 0.2);
+        addSpring(torso, neck1, 0.6, 0.2, 0.2);
+        addSpring(neck1, neck2, 0.6, 0.2, 0.2);
+        addSpring(neck2, head, 0.6, 0.2, 0.2);
+    }
+
+    void addCloudParticle() {
+        cloudSlots.push_back(particles.size());
+        particles.push_back(newCloudParticle());
+    }
+
+    /**
+     * Replace count loose particles, picked at random, with new ones. Removals and spawns
+     * interleave, as when enemies die and bullets are fired in the same step: each group of
+     * three is one removal, one spawn, two removals and two spawns.
+     */
+    void churn(int count) {
+        for (int i = 0; i < count; i += 3) {
+            int group = std::min(std::min(3, count - i), (int) cloudSlots.size());
+            int first = (int) (random.next() * cloudSlots.size());
+            int slots[3];
+            for (int k = 0; k < group; k++) {
+                slots[k] = cloudSlots[(first + k) % cloudSlots.size()];
+            }
+
+            for (int k = 0; k < group; k++) {
+                pm.removeParticle(particles[slots[k]]);
+                if (k == 0) particles[slots[0]] = newCloudParticle();
+            }
+            for (int k = 1; k < group; k++) {
+                particles[slots[k]] = newCloudParticle();
+            }
+        }
+    }
+
+    std::vector<Particle*>& getParticles() { return particles; }
+    int getSpringCount() { return springCount; }
+
+private:
+    Particle* newCloudParticle() {
+        vec3 velocity = randomDirection() * 0.05f;
+        Particle *p = new Particle(nullptr, 3, randomOrigin(), 1, 0.4, 0.9, false, velocity);
+        pm.addParticle(p, false);
+        return p;
+    }
+
+    Particle* addParticle(vec3 position, float mass, float radius) {
+        Particle *p = new Particle(nullptr, 2, position, mass, radius);
+        pm.addParticle(p, false);
+        particles.push_back(p);
+        return p;
+    }
+
+    void addSpring(Particle *p1, Particle *p2, float targetLength, float stiffness, float damping) {
+        pm.addSpring(new Spring(p1, p2, targetLength, stiffness, damping), false);
+        springCount++;
+    }
+
+    vec3 randomOrigin() {
+        float height = START_HEIGHT + random.next() * SLAB_HEIGHT;
+        if (!isClustered) return vec3(random.next() * side - side / 2, height, random.next() * side - side / 2);
+
+        // Uniform in angle and falling off with distance, so the centre is far denser than the edge
+        float angle = random.next() * 6.2831853f;
+        float distance = random.next() * random.next() * side / 2;
+        return vec3(cosf(angle) * distance, height, sinf(angle) * distance);
+    }
+
+    vec3 randomDirection() {
+        vec3 v(random.next() - 0.5f, random.next() - 0.5f, random.next() - 0.5f);
+        float l = length(v);
+        return l > 0 ? v / l : vec3(1, 0, 0);
+    }
+
+    PhysicsManager &pm;
+    Random random;
+    bool isClustered;
+    float side;
+    std::vector<Particle*> particles;
+    int springCount = 0;
+
+    // Indices in particles of loose particles, which churn replaces
+    std::vector<int> cloudSlots;
+};
+
+void buildWorld(WorldBuilder &builder, const std::string &world, int size) {
+    // Mixed worlds hold about a third of their particles in each kind of object
+    while (builder.getParticles().size() < size) {
+        int count = builder.getParticles().size();
+        int remaining = size - count;
+        int kind = world == "chains" ? 0 : world == "rigs" ? 1 : world == "cloud" ? 2 : count % 3;
+
+        if (kind == 0 && remaining >= 6) builder.addChain();
+        else if (kind == 1 && remaining >= 9) builder.addRig();
+        else builder.addCloudParticle();
+    }
+}
+
+void configure(PhysicsManager &pm, const Options &options, int workers) {
+    if (workers >= 0) pm.setWorkerCount(workers);
+    pm.setIntegrator(options.integrator);
+}
+
+/**
+ * Keep the level of detail focus on the first particle, which falls along with the world.
+ */
+void updateFocus(PhysicsManager &pm, const Options &options, std::vector<Particle*> &particles) {
+    if (options.isLod) pm.setLodFocus(particles[0]->getPosition());
+}
+
+Result runScaling(const Options &options, int size) {
+    PhysicsManager pm(options.broadphase);
+    configure(pm, options, options.workers);
+    WorldBuilder builder(pm, size, options.isClustered);
+    buildWorld(builder, options.world, size);
+
+    Result result;
+    result.particles = builder.getParticles().size();
+    result.springs = builder.getSpringCount();
+    result.steps = options.steps > 0 ? options.steps : std::max(10, std::min(200, 10000000 / size));
+
+    for (int i = 0; i < options.warmup; i++) {
+        builder.churn(options.churn);
+        updateFocus(pm, options, builder.getParticles());
+        pm.update(pm.getStepTime());
+    }
+
+    for (int i = 0; i < result.steps; i++) {
+        builder.churn(options.churn);
+        updateFocus(pm, options, builder.getParticles());
+        pm.update(pm.getStepTime());
+        PhysicsStats stats = pm.getStats();
+        result.candidatePairs += stats.candidatePairCount;
+        result.contacts += stats.contactCount;
+        result.activeParticles += stats.activeParticleCount;
+        result.total.islandsNs += stats.islandsNs;
+        result.total.broadphaseNs += stats.broadphaseNs;
+        result.total.narrowphaseNs += stats.narrowphaseNs;
+        result.total.springsNs += stats.springsNs;
+        result.total.integrateNs += stats.integrateNs;
+    }
+    return result;
+}
+
+void printResult(const Options &options, const Result &result, bool isFirst) {
+    double steps = result.steps;
+    const PhysicsStats &t = result.total;
+    const char *broadphase = options.broadphase == Broadphase::SWEEP_AND_PRUNE ? "sap" : "grid";
+    const char *layout = options.isClustered ? "cluster" : "slab";
+
+    if (options.isJson) {
+        printf("%s\n  {\"world\": \"%s\", \"layout\": \"%s\", \"churn\": %d, \"broadphase\": \"%s\", \"integrator\": \"%s\", \"particles\": %d, "
+               "\"springs\": %d, \"steps\": %d, \"pairs\": %.0f, \"contacts\": %.0f, \"active\": %.0f, \"broadphase_ns\": %.0f, \"narrowphase_ns\": %.0f, "
+               "\"springs_ns\": %.0f, \"integrate_ns\": %.0f, \"islands_ns\": %.0f, \"total_ns\": %.0f}",
+               isFirst ? "" : ",", options.world.c_str(), layout, options.churn, broadphase, options.integratorName,
+               result.particles, result.springs, result.steps, result.candidatePairs / steps, result.contacts / steps,
+               result.activeParticles / steps, t.broadphaseNs / steps, t.narrowphaseNs / steps,
+               t.springsNs / steps, t.integrateNs / steps, t.islandsNs / steps, t.totalNs() / steps);
+    } else {
+        printf("%s,%s,%d,%s,%s,%d,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+               options.world.c_str(), layout, options.churn, broadphase, options.integratorName,
+               result.particles, result.springs, result.steps, result.candidatePairs / steps, result.contacts / steps,
+               result.activeParticles / steps, t.broadphaseNs / steps, t.narrowphaseNs / steps,
+               t.springsNs / steps, t.integrateNs / steps, t.islandsNs / steps, t.totalNs() / steps);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Run the same scripted scenario with several worker counts and compare the final state hashes.
+ * Also counts the steps on which the narrowphase and the spring solver had enough work to go
+ * parallel; a world too small for either proves nothing about worker counts and fails.
+ */
+bool checkDeterminism(const Options &options, int size) {
+    const int WORKER_COUNTS[] = { 0, 1, 3, 7 };
+    int steps = options.steps > 0 ? options.steps : 10000;
+    unsigned long long hashes[4];
+    int parallelPairSteps = 0;
+    int parallelSpringSteps = 0;
+
+    for (int w = 0; w < 4; w++) {
+        PhysicsManager pm(options.broadphase);
+        configure(pm, options, WORKER_COUNTS[w]);
+        pm.setDeterministic(true);
+        WorldBuilder builder(pm, size, options.isClustered);
+        buildWorld(builder, options.world, size);
+        std::vector<Particle*> &particles = builder.getParticles();
+
+        for (int i = 0; i < steps; i++) {
+            // Poke a particle now and then, like game code would
+            if (i % 50 == 0) particles[i % particles.size()]->applyForce(vec3(0.2f, 0.1f, 0));
+
+            int frameSteps = pm.beginFrame(0.1);
+            for (int k = 0; k < frameSteps; k++) {
+                updateFocus(pm, options, particles);
+                pm.update(pm.getStepTime());
+
+                PhysicsStats stats = pm.getStats();
+                if (w == 0 && stats.candidatePairCount >= Narrowphase::PARALLEL_THRESHOLD) parallelPairSteps++;
+                if (w == 0 && stats.activeSpringCount >= SpringSolver::PARALLEL_THRESHOLD) parallelSpringSteps++;
+            }
+        }
+        hashes[w] = pm.stateHash();
+    }
+
+    bool isMatch = true;
+    printf("%s,%d,%d,%d,%d", options.world.c_str(), size, steps, parallelPairSteps, parallelSpringSteps);
+    for (int w = 0; w < 4; w++) {
+        printf(",%016llx", hashes[w]);
+        if (hashes[w] != hashes[0]) isMatch = false;
+    }
+
+    if (!isMatch) printf(",MISMATCH\n");
+    else if (parallelPairSteps == 0 || parallelSpringSteps == 0) printf(",TOO_SMALL\n");
+    else printf(",match\n");
+    return isMatch && parallelPairSteps > 0 && parallelSpringSteps > 0;
+}
+
+/**
+ * Run the same churning scenario with each broadphase and compare the final state hashes. Both
+ * find the same pairs, so any difference is a broadphase losing track of particles as they
+ * come and go between steps.
+ */
+bool checkBroadphase(const Options &options, int size) {
+    const Broadphase::Type TYPES[] = { Broadphase::SPATIAL_HASH, Broadphase::SWEEP_AND_PRUNE };
+    int steps = options.steps > 0 ? options.steps : 1000;
+    int churn = options.churn > 0 ? options.churn : 10;
+    unsigned long long hashes[2];
+
+    for (int b = 0; b < 2; b++) {
+        PhysicsManager pm(TYPES[b]);
+        configure(pm, options, options.workers);
+        WorldBuilder builder(pm, size, options.isClustered);
+        buildWorld(builder, options.world, size);
+
+        for (int i = 0; i < steps; i++) {
+            builder.churn(churn);
+            updateFocus(pm, options, builder.getParticles());
+            pm.update(pm.getStepTime());
+        }
+        hashes[b] = pm.stateHash();
+    }
+
+    printf("%s,%d,%d,%d,%016llx,%016llx,%s\n", options.world.c_str(), size, steps, churn, hashes[0], hashes[1],
+           hashes[0] == hashes[1] ? "match" : "MISMATCH");
+    return hashes[0] == hashes[1];
+}
+
+std::vector<int> parseSizes(const char *text) {
+    std::vector<int> sizes;
+    while (*text) {
+        sizes.push_back(atoi(text));
+        const char *comma = strchr(text, ',');
+        if (comma == nullptr) break;
+        text = comma + 1;
+    }
+    return sizes;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg == "--check-determinism") {
+            options.isDeterminismCheck = true;
+            continue;
+        }
+        if (arg == "--check-broadphase") {
+            options.isBroadphaseCheck = true;
+            continue;
+        }
+        if (arg == "--lod") {
+            options.isLod = true;
+            continue;
+        }
+        if (value == nullptr) return false;
+        i++;
+
+        if (arg == "--world") {
+            options.world = value;
+            if (options.world != "chains" && options.world != "rigs" && options.world != "cloud" && options.world != "mixed") return false;
+        } else if (arg == "--layout") {
+            if (strcmp(value, "cluster") == 0) options.isClustered = true;
+            else if (strcmp(value, "slab") != 0) return false;
+        } else if (arg == "--churn") {
+            options.churn = atoi(value);
+        } else if (arg == "--sizes") {
+            options.sizes = parseSizes(value);
+        } else if (arg == "--steps") {
+            options.steps = atoi(value);
+        } else if (arg == "--warmup") {
+            options.warmup = atoi(value);
+        } else if (arg == "--workers") {
+            options.workers = atoi(value);
+        } else if (arg == "--broadphase") {
+            if (strcmp(value, "grid") == 0) options.broadphase = Broadphase::SPATIAL_HASH;
+            else if (strcmp(value, "sap") == 0) options.broadphase = Broadphase::SWEEP_AND_PRUNE;
+            else return false;
+        } else if (arg == "--integrator") {
+            options.integratorName = value;
+            if (strcmp(value, "explicit") == 0) options.integrator = PhysicsManager::EXPLICIT;
+            else if (strcmp(value, "pbd") == 0) options.integrator = PhysicsManager::POSITION_BASED;
+            else if (strcmp(value, "implicit") == 0) options.integrator = PhysicsManager::IMPLICIT;
+            else return false;
+        } else if (arg == "--format") {
+            if (strcmp(value, "json") == 0) options.isJson = true;
+            else if (strcmp(value, "csv") != 0) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--world chains|rigs|cloud|mixed] [--layout slab|cluster] [--churn n] [--sizes n,n,...] [--steps n] [--warmup n] "
+                        "[--workers n] [--broadphase grid|sap] [--integrator explicit|pbd|implicit] "
+                        "[--format csv|json] [--lod] [--check-determinism] [--check-broadphase]\n", argv[0]);
+        return 2;
+    }
+
+    if (options.isDeterminismCheck) {
+        if (options.sizes.empty()) options.sizes.push_back(6000);
+
+        bool isMatch = true;
+        printf("world,particles,steps,parallel_pair_steps,parallel_spring_steps,hash_1_thread,hash_2_threads,hash_4_threads,hash_8_threads,result\n");
+        for (int i = 0; i < options.sizes.size(); i++) {
+            isMatch &= checkDeterminism(options, options.sizes[i]);
+        }
+        return isMatch ? 0 : 1;
+    }
+
+    if (options.isBroadphaseCheck) {
+        if (options.sizes.empty()) options.sizes.push_back(2000);
+
+        bool isMatch = true;
+        printf("world,particles,steps,churn,hash_grid,hash_sap,result\n");
+        for (int i = 0; i < options.sizes.size(); i++) {
+            isMatch &= checkBroadphase(options, options.sizes[i]);
+        }
+        return isMatch ? 0 : 1;
+    }
+
+    if (options.sizes.empty()) {
+        for (int size = 100; size <= 1000000; size *= 10) {
+            options.sizes.push_back(size);
+        }
+    }
+
+    if (options.isJson) printf("[");
+    else printf("world,layout,churn,broadphase,integrator,particles,springs,steps,pairs,contacts,active,broadphase_ns,narrowphase_ns,springs_ns,integrate_ns,islands_ns,total_ns\n");
+
+    for (int i = 0; i < options.sizes.size(); i++) {
+        printResult(options, runScaling(options, options.sizes[i]), i == 0);
+    }
+
+    if (options.isJson) printf("\n]\n");
+    return 0;
+}
@@ -323,6 +323,7 @@ bool ReadAsciiObj(const char    *filename,
     vector<vec3> tmpVertices, tmpNormals;
     vector<vec2> tmpTextures;
     VidMap vidMap;
+    vector<int> vids;
     for (int lineNum = 0;; lineNum++) {
         line[0] = 0;
         fgets(line, LineLim, in);                  // \ line continuation not supported
@@ -364,7 +365,6 @@ bool ReadAsciiObj(const char    *filename,
             tmpTextures.push_back(vec2(t.x, t.y));
         }
         else if (!strcmp(word, "f")) {                // read triangle or polygon
-            static vector<int> vids;
             vids.resize(0);
             while (ReadWord(ptr, word, WordLim)) {      // read arbitrary # face vid/tid/nid
                 // set texture and normal pointers to preceding /
@@ -0,0 +1,61 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "particle_store.h"
+
+#include "VecMat.h"
+
+#include <utility>
+#include <vector>
+
+/**
+ * Finds pairs of particles that may be touching, so the narrowphase only runs the exact sphere
+ * test on those.
+ */
+class Broadphase {
+public:
+    enum Type { SPATIAL_HASH, SWEEP_AND_PRUNE };
+
+    virtual ~Broadphase() { }
+
+    /**
+     * Collect candidate pairs (i < j) that include every touching pair of particles whose
+     * collision filters let them collide, in the same order as a nested i/j loop over all
+     * particles. Filters are checked before any geometry test.
+     */
+    virtual void findPairs(const ParticleStore &store, std::vector<std::pair<int, int>> &pairs) = 0;
+
+    /**
+     * Collect, in increasing order, particles that include every particle whose sphere where
+     * it was at the last findPairs() overlaps the box from lower to upper. Only valid until
+     * particles are added or removed. By default every particle is returned.
+     */
+    virtual void query(const ParticleStore &store, vec3 lower, vec3 upper, std::vector<int> &particles) {
+        particles.clear();
+        for (int i = 0; i < store.size(); i++) {
+            particles.push_back(i);
+        }
+    }
+
+    /**
+     * Drop state kept between steps. Called whenever particles move to different indices other
+     * than through particleAdded or particleRemoved, e.g. when a snapshot is restored.
+     */
+    virtual void invalidate() { }
+
+    /**
+     * Called after a particle is appended to the store at index i.
+     */
+    virtual void particleAdded(int i) {
+        invalidate();
+    }
+
+    /**
+     * Called after ParticleStore::remove(i), which moves the last particle into index i.
+     */
+    virtual void particleRemoved(int i) {
+        invalidate();
+    }
+};
+
+#endif
@@ -1,27 +1,36 @@
 #ifndef BULLET_H
 #define BULLET_H
 
+#include "object_pool.h"
 #include "particle.h"
+#include "physics_manager.h"
 
 #include "VecMat.h"
 
-class Bullet: public GameObject {
+class Bullet: public GameObject, public Pooled<Bullet> {
 public:
-    Bullet(vec3 position, vec3 velocity) {
+    Bullet(PhysicsManager *pm, EntityStore *entities, vec3 position, vec3 velocity)
+        : GameObject(entities) {
         objectId = BULLET;
-        color = vec3(1, 1, 1);
-
-        health = MAX_HEALTH;
-        collisionCooldown = MAX_COLLISION_COOLDOWN;
-        isCoolingDown = false;
-        cooldownFlashTimer = 0;
-        isCooldownFlash = false;
+        entities->health.add(entity, Health { MAX_HEALTH, MAX_HEALTH });
+        entities->tints.add(entity, Tint { COLOR, COLOR, COLOR });
 
+        // Fast and small enough to pass between steps through thin limbs such as emu knees
         particle = new Particle(this, 0, position, 1, 0.4, 0.9, false, velocity);
-    }
+        particle->setContinuous(true);
 
-    void update(double timeDelta, void*) override {
+        // Bullets pass through each other and the player who fired them
+        particle->setCollisionFilter(collisionFilter(CollisionFilter::PROJECTILE, CollisionFilter::ALL & ~(CollisionFilter::PROJECTILE | CollisionFilter::PLAYER), false));
+        pm->addParticle(particle);
+    }
 
+    /**
+     * Fire a spent bullet again, while its particle is out of the simulation (see EntityRecycler).
+     */
+    void rearm(vec3 position, vec3 velocity) {
+        health().current = MAX_HEALTH;
+        particle->setPosition(position);
+        particle->setVelocity(velocity);
     }
 
     void collideWith(void *thisCollider, void *otherCollider) override {
@@ -32,25 +41,29 @@ public:
 
         // Centipede collision
         if (otherObjectId == 1) {
-            health--;
+            health().current--;
         }
 
         // Centipede collision
         if (otherObjectId == 2) {
-            health--;
+            health().current--;
         }
 
-        if (health <= 0) {
-            particle->setPosition(vec3(0, 0, -1000));
-            particle->setVelocity(vec3(0, 0, 0));
-        }
+    }
+
+    /**
+     * Spent bullets and bullets that fell off the arena are removed by the game.
+     */
+    bool isDead() {
+        return health().current <= 0 || particle->getPosition().y < MIN_HEIGHT;
     }
 
     Particle* getParticle() { return particle; }
 
 private:
     const int MAX_HEALTH = 1;
-    const float MAX_COLLISION_COOLDOWN = 0;
+    const float MIN_HEIGHT = -100;
+    const vec3 COLOR = vec3(1, 1, 1);
 
     Particle *particle;
 };
@@ -2,77 +2,66 @@
 #define CENTIPEDE_H
 
 #include "game_object.h"
+#include "object_pool.h"
 #include "particle.h"
 #include "physics_manager.h"
-#include "player.h"
 #include "spring.h"
 
 #include "VecMat.h"
 
 #include <vector>
 
-class Centipede: public GameObject {
+class Centipede: public GameObject, public Pooled<Centipede> {
 public:
-    Centipede(PhysicsManager *pm, vec3 controllerPosition) {
+    Centipede(PhysicsManager *pm, EntityStore *entities, vec3 controllerPosition)
+        : GameObject(entities) {
         objectId = CENTIPEDE;
-        color = vec3(1.0, 0.4, 0.5);
-
-        health = MAX_HEALTH;
-        collisionCooldown = MAX_COLLISION_COOLDOWN;
-        isCoolingDown = false;
-        cooldownFlashTimer = 0;
-        isCooldownFlash = false;
-
-        this->controllerPosition = controllerPosition;
-        controllerDirection = vec3(0, 0, 1);
-        controllerVelocity = vec3(0.1, 0, 0);
+        addVitals(MAX_HEALTH, MAX_COLLISION_COOLDOWN, vec3(1.0, 0.4, 0.5));
 
         head = new Particle(this, objectId, vec3(controllerPosition), 1, 0.8, 0.95, false);
-        pm->addParticle(head);
-
-        Particle *prevMadeParticle = head;
         bodySegments.push_back(head);
         for (int i = 1; i < NUM_BODY_SEGMENTS; i++) {
-            Particle *nextParticle = new Particle(
-                this, objectId, vec3(controllerPosition - controllerDirection * 2.5 * i), 1, 0.8, 0.95
-            );
-            pm->addParticle(nextParticle);
-            pm->addSpring(new Spring(prevMadeParticle, nextParticle, 2.5, 0.01, 0.001));
-            prevMadeParticle = nextParticle;
-            bodySegments.push_back(nextParticle);
+            bodySegments.push_back(new Particle(this, objectId, controllerPosition, 1, 0.8, 0.95));
+        }
+        CollisionFilter filter = collisionFilter(CollisionFilter::ENEMY, CollisionFilter::ALL, false);
+        for (int i = 0; i < NUM_BODY_SEGMENTS; i++) {
+            bodySegments[i]->setCollisionFilter(filter);
+        }
+        rearm(controllerPosition);
+
+        pm->addParticle(head);
+        for (int i = 1; i < NUM_BODY_SEGMENTS; i++) {
+            pm->addParticle(bodySegments[i]);
+            pm->addSpring(new Spring(bodySegments[i - 1], bodySegments[i], SEGMENT_LENGTH, 0.01, 0.001));
         }
     }
 
     /**
-     * Always follow the player.
+     * Lie straight along +z with the head at controllerPosition, at full health. Run while the
+     * particles are out of the simulation: by the constructor, and when a dead centipede is
+     * spawned again (see EntityRecycler).
      */
-    void update(double timeDelta, void* playerPointer) override {
-        Player* player = static_cast<Player*>(playerPointer);
-        vec3 playerPosition = player->getControllerPosition();
-        vec3 targetPosition = vec3(playerPosition.x, 1, playerPosition.z);
-        vec3 force = normalize(targetPosition - head->getPosition()) * 0.010f;
-
-        head->applyForce(force);
+    void rearm(vec3 controllerPosition) {
+        resetVitals();
 
-        if (isCoolingDown) {
-            color = isCooldownFlash ? vec3(1.0, 0, 0) : vec3(1.0, 0.4, 0.5);
-            cooldownFlashTimer += timeDelta;
-            if (cooldownFlashTimer >= MAX_COOLDOWN_FLASH_TIME) {
-                isCooldownFlash = !isCooldownFlash;
-                cooldownFlashTimer = 0;
-            }
-            collisionCooldown -= timeDelta;
-            if (collisionCooldown <= 0) {
-                isCoolingDown = false;
-                collisionCooldown = MAX_COLLISION_COOLDOWN;
-            }
-        } else {
-            color = vec3(1.0, 0.4, 0.5);
+        vec3 controllerDirection = vec3(0, 0, 1);
+        for (int i = 0; i < NUM_BODY_SEGMENTS; i++) {
+            bodySegments[i]->setPosition(controllerPosition - controllerDirection * SEGMENT_LENGTH * i);
+            bodySegments[i]->setVelocity(vec3(0, 0, 0));
         }
     }
 
+    /**
+     * Pull the head with the force EnemyAi chose; the body follows on its springs.
+     */
+    void steer(vec3 force) {
+        head->applyForce(force);
+    }
+
+    vec3 getHeadPosition() { return head->getPosition(); }
+
     void collideWith(void* thisCollider, void* otherCollider) override {
-        if (isCoolingDown) return;
+        if (cooldown().isActive) return;
 
         Particle* thisParticle = static_cast<Particle*>(thisCollider);
         Particle* otherParticle = static_cast<Particle*>(otherCollider);
@@ -83,33 +72,30 @@ public:
         if (otherObjectId == 0) {
             vec3 responseForce = (thisParticle->getPosition() - otherParticle->getPosition()) * 0.05f;
             thisParticle->applyForce(responseForce);
-            health--;
-            isCoolingDown = true;
+            health().current--;
+            cooldown().start();
         }
 
         // Collision with bullet
         if (otherObjectId == -1) {
             vec3 responseForce = (thisParticle->getPosition() - otherParticle->getPosition()) * 0.05f;
             thisParticle->applyForce(responseForce);
-            health--;
-        }
-
-        if (health < 0) {
-            for (int i = 0; i < bodySegments.size(); i++) {
-                bodySegments[i]->setPosition(vec3(0, 0, -100));
-            }
+            health().current--;
         }
     }
 
+    bool isDead() { return health().current < 0; }
+
+    // The head always crawls toward the player at this height, pulled with this force
+    static constexpr float SEEK_HEIGHT = 1.0f;
+    static constexpr float SEEK_FORCE = 0.010f;
+
 private:
     const int NUM_BODY_SEGMENTS = 6;
+    const float SEGMENT_LENGTH = 2.5;
     const int MAX_HEALTH = 1;
     const float MAX_COLLISION_COOLDOWN = 1;
 
-    vec3 controllerPosition;
-    vec3 controllerDirection;
-    vec3 controllerVelocity;
-
     Particle *head;
     std::vector<Particle*> bodySegments;
 };
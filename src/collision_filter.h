@@ -0,0 +1,30 @@
+#ifndef COLLISION_FILTER_H
+#define COLLISION_FILTER_H
+
+/**
+ * Which particles a particle collides with. Two particles collide only if each one's layer is
+ * in the other's mask, and they are not in the same group. A group usually holds the particles
+ * of one entity that should not push each other; particles in NO_GROUP are never rejected by
+ * group. The broadphase applies the filter before any geometry test, so filtered pairs cost
+ * nothing past the pair search.
+ */
+struct CollisionFilter {
+    static const unsigned int DEFAULT = 1u << 0;
+    static const unsigned int PLAYER = 1u << 1;
+    static const unsigned int ENEMY = 1u << 2;
+    static const unsigned int PROJECTILE = 1u << 3;
+    static const unsigned int ALL = ~0u;
+
+    static const int NO_GROUP = -1;
+
+    unsigned int layer;
+    unsigned int mask;
+    int group;
+
+    CollisionFilter(unsigned int layer=DEFAULT, unsigned int mask=ALL, int group=NO_GROUP)
+        : layer(layer)
+        , mask(mask)
+        , group(group) { }
+};
+
+#endif
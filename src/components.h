@@ -0,0 +1,104 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include "game_random.h"
+
+#include "VecMat.h"
+
+#include <math.h>
+
+/**
+ * Components shared by the game's entities. They are plain data, kept in packed arrays by the
+ * EntityStore, so the systems that update them walk contiguous memory.
+ */
+
+struct Health {
+    int current;
+    int max;
+};
+
+/**
+ * Invulnerability after a hit. While active, the entity ignores further hits and its Tint
+ * flashes between its base and flash colours.
+ */
+struct Cooldown {
+    float duration;     // Length of a cooldown started by a hit
+    float remaining;
+    float flashTimer;
+    bool isActive;
+    bool isFlashOn;
+
+    /**
+     * Start a cooldown of duration. One already running carries on unchanged: remaining is
+     * only reset to duration when a cooldown ends.
+     */
+    void start() {
+        isActive = true;
+    }
+
+    /**
+     * Start a cooldown of the given length. Later cooldowns last duration again.
+     */
+    void start(float time) {
+        remaining = time;
+        isActive = true;
+    }
+};
+
+struct Tint {
+    vec3 base;
+    vec3 flash;
+    vec3 current;
+};
+
+/**
+ * Controller that walking entities steer. The body faces along the path of an invisible tail
+ * dragged behind the controller.
+ */
+struct Locomotion {
+    vec3 position;
+    vec3 velocity;
+    vec3 tailPosition;
+    vec3 bodyDirection;
+
+    /**
+     * Move by the velocity set for this step and turn the body to follow.
+     */
+    void advance() {
+        position += velocity;
+
+        vec3 delta = position - tailPosition;
+        float r = TAIL_LENGTH / length(delta);
+        tailPosition = position - delta * r;
+        delta = normalize(position - tailPosition);
+        bodyDirection.x = delta.x;
+        bodyDirection.y = 0;
+        bodyDirection.z = delta.z;
+    }
+
+    static constexpr float TAIL_LENGTH = 0.5f;
+};
+
+/**
+ * Where an enemy is heading. Each enemy draws from a random generator of its own, so enemies
+ * can be steered in parallel and in any order with the same result.
+ */
+struct Steering {
+    vec3 target;
+    float timeToSwitchTarget;
+    bool isTargetingPlayer;
+    GameRandom random;
+};
+
+/**
+ * Walk cycle of a legged entity: each foot steps toward its target, one foot per stride.
+ */
+struct Gait {
+    vec3 leftFootTarget;
+    vec3 rightFootTarget;
+    float stride;
+    float strideLength;
+    bool shouldMoveLeftFoot;
+};
+
+#endif
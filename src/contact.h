@@ -0,0 +1,19 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include "game_object.h"
+
+#include "VecMat.h"
+
+/**
+ * Touching pair of particles found during a physics step. Particles are referred to by their
+ * index in the ParticleStore, which stays valid until particles are added or removed.
+ */
+struct Contact {
+    int particle1, particle2;
+    GameObject *owner1, *owner2;
+    vec3 normal;    // Unit vector from particle1 towards particle2
+    float depth;    // How far the two spheres overlap
+};
+
+#endif
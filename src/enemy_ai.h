@@ -0,0 +1,107 @@
+#ifndef ENEMY_AI_H
+#define ENEMY_AI_H
+
+#include "centipede.h"
+#include "components.h"
+#include "emu.h"
+#include "entity_store.h"
+#include "job_system.h"
+
+#include "VecMat.h"
+
+#include <vector>
+
+/**
+ * Steering for every enemy in one pass. The player's position is read once per step, and each
+ * emu is steered and given foot targets in place in the EntityStore, then moves its body.
+ * Emus only touch their own components and particles, so chunks of them run in parallel on the
+ * JobSystem. Centipedes need only a seek force toward the player.
+ */
+class EnemyAi {
+public:
+    EnemyAi() {
+    }
+
+    void update(EntityStore &entities, const std::vector<Emu*> &emus, const std::vector<Centipede*> &centipedes,
+                vec3 playerPosition, double timeDelta, JobSystem &jobSystem) {
+        jobSystem.parallelFor(emus.size(), GRAIN_SIZE, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Entity entity = emus[i]->getEntity();
+                Locomotion &locomotion = entities.locomotion.get(entity);
+                steerEmu(entities.steering.get(entity), locomotion, emus[i]->getBasePosition(), playerPosition, (float) timeDelta);
+                planStride(locomotion, entities.gaits.get(entity));
+                emus[i]->moveBody();
+            }
+        });
+
+        jobSystem.parallelFor(centipedes.size(), GRAIN_SIZE, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                vec3 target = vec3(playerPosition.x, Centipede::SEEK_HEIGHT, playerPosition.z);
+                centipedes[i]->steer(normalize(target - centipedes[i]->getHeadPosition()) * Centipede::SEEK_FORCE);
+            }
+        });
+    }
+
+private:
+    // Enemies per job; a handful of enemies is cheaper to update on one thread
+    static const int GRAIN_SIZE = 16;
+
+    /**
+     * Chase the player when near, otherwise wander between random targets.
+     */
+    static void steerEmu(Steering &s, Locomotion &l, vec3 basePosition, vec3 playerPosition, float timeDelta) {
+        vec3 &velocity = l.velocity;
+
+        s.isTargetingPlayer = length(l.position - playerPosition) < Emu::CHASE_DISTANCE;
+
+        if (s.isTargetingPlayer) {
+            s.target = playerPosition;
+            velocity = normalize(s.target - basePosition) * Emu::MAX_SPEED;
+        } else {
+            s.timeToSwitchTarget -= timeDelta;
+            if (s.timeToSwitchTarget <= 0) {
+                int targetX = s.random.next(40) - 20;
+                int targetZ = s.random.next(40) - 20;
+                s.target = vec3(targetX, 0, targetZ);
+                s.timeToSwitchTarget = 2 + s.random.next(5);
+            }
+            velocity = normalize(s.target - basePosition) * (Emu::MAX_SPEED * Emu::WANDER_SPEED);
+        }
+
+        velocity.y = 0;
+    }
+
+    /**
+     * Move the controller and, once it has gone a stride, plant the next foot ahead of it.
+     * Faster emus take longer strides.
+     */
+    static void planStride(Locomotion &l, Gait &gait) {
+        const vec3 up = vec3(0, 1, 0);
+
+        l.advance();
+
+        const vec3 horizontalVelocity = vec3(l.velocity.x, 0, l.velocity.z);
+        gait.stride += length(horizontalVelocity);
+
+        // Determine the length of a stride based on the current horizontal velocity
+        gait.strideLength = length(horizontalVelocity) * 19.0;
+        if (gait.strideLength < 0.6) gait.strideLength = 0.6;
+
+        // Start a new stride with the opposite foot
+        if (gait.stride >= gait.strideLength) {
+            const vec3 footStraddleOffset = normalize(cross(horizontalVelocity, up)) * Emu::FOOT_STRADDLE_OFFSET;
+            const vec3 footTarget = l.position + normalize(horizontalVelocity) * (Emu::STRIDE_LENGTH_MIN + length(l.velocity) * 21);
+
+            if (gait.shouldMoveLeftFoot) {
+                gait.rightFootTarget = footTarget + footStraddleOffset;
+            } else {
+                gait.leftFootTarget = footTarget - footStraddleOffset;
+            }
+
+            gait.stride = 0;
+            gait.shouldMoveLeftFoot = !gait.shouldMoveLeftFoot;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef ENTITY_RECYCLER_H
+#define ENTITY_RECYCLER_H
+
+#include "entity_store.h"
+#include "physics_manager.h"
+
+#include <utility>
+#include <vector>
+
+/**
+ * Free list of dead entities of one kind. A dead entity keeps its components, particles and
+ * springs; only its body is taken out of the simulation. The next spawn of that kind re-arms it
+ * in place with T::rearm and puts the body back, so a long session allocates no more entities,
+ * particles or springs than were ever alive at once.
+ *
+ * T is constructed as T(pm, entities, args...) and re-armed as T::rearm(args...). Like entity
+ * creation, recycling happens on the game thread only.
+ */
+template <typename T>
+class EntityRecycler {
+public:
+    EntityRecycler(PhysicsManager *pm, EntityStore *entities)
+        : pm(pm)
+        , entities(entities) { }
+
+    EntityRecycler(const EntityRecycler&) = delete;
+    EntityRecycler &operator=(const EntityRecycler&) = delete;
+
+    ~EntityRecycler() {
+        for (int i = 0; i < free.size(); i++) {
+            free[i].body.clear();
+            delete free[i].object;
+        }
+    }
+
+    /**
+     * A dead entity re-armed with args if there is one, otherwise a new entity.
+     */
+    template <typename... Args>
+    T* spawn(Args... args) {
+        if (free.empty()) return new T(pm, entities, args...);
+
+        Entry entry = std::move(free.back());
+        free.pop_back();
+        entry.object->rearm(args...);
+        pm->attach(entry.body);
+        return entry.object;
+    }
+
+    /**
+     * Take a dead entity's body out of the simulation and keep the entity for the next spawn.
+     */
+    void recycle(T *object) {
+        free.push_back(Entry());
+        free.back().object = object;
+        pm->detachOwner(object, free.back().body);
+    }
+
+    int getFreeCount() const { return free.size(); }
+
+private:
+    struct Entry {
+        T *object;
+        DetachedBody body;
+    };
+
+    PhysicsManager *pm;
+    EntityStore *entities;
+    std::vector<Entry> free;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include "components.h"
+#include "snapshot.h"
+
+#include "VecMat.h"
+
+#include <vector>
+
+typedef int Entity;
+
+/**
+ * Components of one type for any number of entities, as a sparse set: values sit packed in
+ * one array for systems to walk, and a table indexed by entity finds an entity's value.
+ * Removal moves the last value into the freed slot, so references to values stay valid only
+ * until a component of the same type is added or removed.
+ */
+template <typename T>
+class ComponentArray {
+public:
+    T& add(Entity entity, const T &value) {
+        if (entity >= slots.size()) slots.resize(entity + 1, -1);
+
+        slots[entity] = values.size();
+        values.push_back(value);
+        entities.push_back(entity);
+        return values.back();
+    }
+
+    void remove(Entity entity) {
+        if (!has(entity)) return;
+
+        int slot = slots[entity];
+        values[slot] = values.back();
+        entities[slot] = entities.back();
+        slots[entities[slot]] = slot;
+        values.pop_back();
+        entities.pop_back();
+        slots[entity] = -1;
+    }
+
+    bool has(Entity entity) const { return entity < slots.size() && slots[entity] >= 0; }
+
+    T& get(Entity entity) { return values[slots[entity]]; }
+    const T& get(Entity entity) const { return values[slots[entity]]; }
+    T* find(Entity entity) { return has(entity) ? &values[slots[entity]] : nullptr; }
+
+    /**
+     * Packed access for systems: value i belongs to getEntity(i).
+     */
+    int size() const { return values.size(); }
+    T& operator[](int i) { return values[i]; }
+    Entity getEntity(int i) const { return entities[i]; }
+
+private:
+    std::vector<T> values;
+    std::vector<Entity> entities;
+    std::vector<int> slots;
+};
+
+/**
+ * Entities and their components, and the systems that update components the same way for
+ * every kind of entity. Behaviour specific to one kind of entity stays in its class (see
+ * GameObject), which reads and writes its components here.
+ *
+ * Entities are created and destroyed on the game thread only. Entity updates that run in
+ * parallel may each change their own entity's components, but not add or remove any.
+ */
+class EntityStore {
+public:
+    EntityStore() {
+    }
+
+    EntityStore(const EntityStore&) = delete;
+    EntityStore &operator=(const EntityStore&) = delete;
+
+    /**
+     * New entity without components. Ids of destroyed entities are reused.
+     */
+    Entity create() {
+        if (!freeIds.empty()) {
+            Entity entity = freeIds.back();
+            freeIds.pop_back();
+            return entity;
+        }
+        return nextId++;
+    }
+
+    void destroy(Entity entity) {
+        health.remove(entity);
+        cooldowns.remove(entity);
+        tints.remove(entity);
+        locomotion.remove(entity);
+        steering.remove(entity);
+        gaits.remove(entity);
+        freeIds.push_back(entity);
+    }
+
+    /**
+     * Run once per step after the entity updates: colour every entity by its cooldown, then
+     * count cooldowns down and flip their flash.
+     */
+    void updateCooldowns(double timeDelta) {
+        for (int i = 0; i < tints.size(); i++) {
+            Tint &tint = tints[i];
+            Cooldown *cooldown = cooldowns.find(tints.getEntity(i));
+            tint.current = cooldown != nullptr && cooldown->isActive && cooldown->isFlashOn ? tint.flash : tint.base;
+        }
+
+        for (int i = 0; i < cooldowns.size(); i++) {
+            Cooldown &cooldown = cooldowns[i];
+            if (!cooldown.isActive) continue;
+
+            cooldown.flashTimer += timeDelta;
+            if (cooldown.flashTimer >= FLASH_TIME) {
+                cooldown.isFlashOn = !cooldown.isFlashOn;
+                cooldown.flashTimer = 0;
+            }
+            cooldown.remaining -= timeDelta;
+            if (cooldown.remaining <= 0) {
+                cooldown.isActive = false;
+                cooldown.remaining = cooldown.duration;
+            }
+        }
+    }
+
+    /**
+     * Write the components of one entity for a snapshot. The entity must have the same
+     * components when it is restored.
+     */
+    void save(Entity entity, SnapshotWriter &writer) {
+        if (health.has(entity)) writer.write(health.get(entity));
+        if (cooldowns.has(entity)) writer.write(cooldowns.get(entity));
+        if (tints.has(entity)) writer.write(tints.get(entity));
+        if (locomotion.has(entity)) writer.write(locomotion.get(entity));
+        if (steering.has(entity)) writer.write(steering.get(entity));
+        if (gaits.has(entity)) writer.write(gaits.get(entity));
+    }
+
+    void restore(Entity entity, SnapshotReader &reader) {
+        if (health.has(entity)) reader.read(health.get(entity));
+        if (cooldowns.has(entity)) reader.read(cooldowns.get(entity));
+        if (tints.has(entity)) reader.read(tints.get(entity));
+        if (locomotion.has(entity)) reader.read(locomotion.get(entity));
+        if (steering.has(entity)) reader.read(steering.get(entity));
+        if (gaits.has(entity)) reader.read(gaits.get(entity));
+    }
+
+    ComponentArray<Health> health;
+    ComponentArray<Cooldown> cooldowns;
+    ComponentArray<Tint> tints;
+    ComponentArray<Locomotion> locomotion;
+    ComponentArray<Steering> steering;
+    ComponentArray<Gait> gaits;
+
+private:
+    // Time between flashes of an entity in cooldown
+    static constexpr float FLASH_TIME = 0.08f;
+
+    Entity nextId = 0;
+    std::vector<Entity> freeIds;
+};
+
+#endif
@@ -1,14 +1,13 @@
 #ifndef GAME_H
 #define GAME_H
 
-#include "bullet.h"
-#include "centipede.h"
-#include "emu.h"
 #include "game_camera.h"
+#include "game_world.h"
+#include "job_system.h"
 #include "model.h"
 #include "particle.h"
-#include "physics_manager.h"
 #include "player.h"
+#include "player_input.h"
 #include "spring.h"
 
 #include "GLXtras.h"
@@ -19,10 +18,12 @@
 #include <glad.h>
 #include <GLFW/glfw3.h>
 
-#include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 #include <vector>
 
+/**
+ * Window, rendering and input around a GameWorld.
+ */
 class Game {
 public:
     Game(GLFWwindow *window, unsigned int screenWidth, int screenHeight)
@@ -31,58 +32,43 @@ public:
         , cubeModel(vec3(1.0f, 0.3f, 0.4f))
         , cylinderModel(vec3(1.0f, 1.0f, 1.0f))
         , monkeyModel(vec3(0.3f, 0.7f, 0.0f))
+        , world(time(NULL))
     {
         this->window = window;
-        sphereModel.read("./assets/sphere.obj");
-        cubeModel.read("./assets/cube.obj");
-        cylinderModel.read("./assets/cylinder.obj");
-        monkeyModel.read("./assets/monkey.obj");
 
-        sceneShader = LinkProgramViaFile("./src/shaders/scene_vshader.txt", "./src/shaders/scene_fshader.txt");
-        hudShader = LinkProgramViaFile("./src/shaders/hud_vshader.txt", "./src/shaders/hud_fshader.txt");
-
-        srand(time(NULL));
-
-        player = new Player(&pm, vec3(0, 0, 0));
-        gameObjects.push_back(player);
-    }
-
-    void update(double timeDelta) {
-
-        timeToSpawnEnemy -= timeDelta;
-        if (timeToSpawnEnemy <= 0) {
-            vec3 spawnPosition = vec3(rand() % 40 - 20, 0, rand() % 40 - 20);
-            while (length(spawnPosition - player->getControllerPosition()) < 5) {
-                spawnPosition = vec3(rand() % 40 - 20, 0, rand() % 40 - 20);
-            }
+        // Parse the meshes in parallel, then upload them here since GL calls need this thread
+        Model *models[] = { &sphereModel, &cubeModel, &cylinderModel, &monkeyModel };
+        const char *meshNames[] = { "./assets/sphere.obj", "./assets/cube.obj", "./assets/cylinder.obj", "./assets/monkey.obj" };
+        bool isLoaded[4];
 
-            if (rand() % 5 < 2) {
-                gameObjects.push_back(new Centipede(&pm, spawnPosition));
-            } else {
-                gameObjects.push_back(new Emu(&pm, spawnPosition));
-            }
+        JobCounter loading;
+        for (int i = 0; i < 4; i++) {
+            jobSystem.run([&, i] { isLoaded[i] = models[i]->load(meshNames[i]); }, &loading);
+        }
+        jobSystem.wait(loading);
 
-            timeToSpawnEnemy = rand() % 5 + 5;
+        for (int i = 0; i < 4; i++) {
+            if (isLoaded[i]) models[i]->buffer();
         }
 
-        // Update physics
-        pm.update(timeDelta);
+        sceneShader = LinkProgramViaFile("./src/shaders/scene_vshader.txt", "./src/shaders/scene_fshader.txt");
+        hudShader = LinkProgramViaFile("./src/shaders/hud_vshader.txt", "./src/shaders/hud_fshader.txt");
 
-        Bullet *bullet = player->input(window, &pm);
-        if (bullet != nullptr) {
-            gameObjects.push_back(bullet);
-            pm.addParticle(bullet->getParticle());
-        }
+        glfwGetCursorPos(window, &lastMouseX, &lastMouseY);
+    }
 
-        // Update entities
-        for (int i = 0; i < gameObjects.size(); i++) {
-            gameObjects[i]->update(timeDelta, player);
-        }
+    void update(double timeDelta) {
+        world.update(timeDelta, readInput());
 
+        Player *player = world.getPlayer();
         gameCamera.update(timeDelta, player);
+        world.getPhysics().setLodFocus(player->getControllerPosition(), gameCamera.getView());
     }
 
     void draw() {
+        PhysicsManager &pm = world.getPhysics();
+        Player *player = world.getPlayer();
+
         // Clear screen
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -112,7 +98,7 @@ public:
 
             sphereModel.draw(sceneShader);
 
-            vec3 particlePosition = particle->getPosition();
+            vec3 particlePosition = particle->getRenderPosition();
 
             if (particlePosition.x >= -25 && particlePosition.x <= 25) {
                 if (particlePosition.z >= -25 && particlePosition.z <= 25) {
@@ -150,7 +136,7 @@ public:
         monkeyModel.setColor(player->getColor());
         monkeyModel.draw(sceneShader);
     
-        vec3 playerPosition = player->getControllerPosition();
+        vec3 playerPosition = player->getRenderPosition();
 
         // Draw base cylinder shadow
         if (playerPosition.x >= -25 && playerPosition.x <= 25) {
@@ -170,19 +156,37 @@ public:
     }
 
 private:
+    /**
+     * Controls from the keyboard, and the cursor movement since the last frame.
+     */
+    PlayerInput readInput() {
+        PlayerInput controls;
+        controls.isForward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+        controls.isBackward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        controls.isLeft = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+        controls.isRight = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+        controls.isJumping = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        controls.isFiring = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+
+        double mouseX, mouseY;
+        glfwGetCursorPos(window, &mouseX, &mouseY);
+        controls.lookX = mouseX - lastMouseX;
+        controls.lookY = lastMouseY - mouseY;
+        lastMouseX = mouseX;
+        lastMouseY = mouseY;
+
+        return controls;
+    }
+
     GLFWwindow *window;
+    double lastMouseX, lastMouseY;
     int sceneShader, hudShader;
 
     Model sphereModel, cubeModel, cylinderModel, monkeyModel;
 
-    PhysicsManager pm;
+    JobSystem &jobSystem = JobSystem::getShared();
     GameCamera gameCamera;
-
-    std::vector<GameObject*> gameObjects;
-
-    Player *player;
-
-    float timeToSpawnEnemy = 5;
+    GameWorld world;
 };
 
 #endif
@@ -14,7 +14,7 @@ public:
     }
 
     void update(double timeDelta, Player *player) {
-        vec3 playerPosition = player->getControllerPosition();
+        vec3 playerPosition = player->getRenderPosition();
         vec3 lookDirection = player->getLookDirection();
         position = playerPosition - lookDirection * DISTANCE_FROM_TARGET;
         vec3 target = position + lookDirection;
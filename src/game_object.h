@@ -1,36 +1,99 @@
 #ifndef GAME_OBJECT_H
 #define GAME_OBJECT_H
 
+#include "collision_filter.h"
+#include "entity_store.h"
+#include "snapshot.h"
+
 #include "VecMat.h"
 
+/**
+ * Entity that owns particles. The state every kind of entity shares lives in components in the
+ * EntityStore; subclasses add their own behaviour and state. The game keeps each kind of
+ * entity in a list of its own and updates it without virtual calls; only collision callbacks
+ * and snapshots go through this class.
+ */
 class GameObject {
 
     public:
-        virtual void update(double, void*) = 0;
+        GameObject(EntityStore *entities)
+            : entities(entities)
+            , entity(entities->create()) { }
+
         virtual void collideWith(void*, void*) = 0;
-        virtual vec3 getColor() { return color; }
-        virtual ~GameObject() { };
+
+        virtual ~GameObject() {
+            entities->destroy(entity);
+        }
+
+        vec3 getColor() { return entities->tints.get(entity).current; }
+        Entity getEntity() { return entity; }
+
+        /**
+         * Write the entity's simulation state for a snapshot. Overrides must call the base
+         * version first and write the same fields restoreState reads, in the same order.
+         */
+        virtual void saveState(SnapshotWriter &writer) {
+            entities->save(entity, writer);
+        }
+
+        virtual void restoreState(SnapshotReader &reader) {
+            entities->restore(entity, reader);
+        }
 
     protected:
         const int PLAYER = 0;
         const int CENTIPEDE = 1;
         const int EMU = 2;
         const int BULLET = 3;
-        const float MAX_COOLDOWN_FLASH_TIME = 0.08f;
 
-        int objectId;
-        int health;
-        float collisionCooldown;
-        float cooldownFlashTimer;
-        bool isCooldownFlash;
+        Health& health() { return entities->health.get(entity); }
+        Cooldown& cooldown() { return entities->cooldowns.get(entity); }
+        Locomotion& locomotion() { return entities->locomotion.get(entity); }
 
-        bool isCoolingDown;
-        vec3 color;
+        /**
+         * Give the entity the components every enemy and the player have.
+         */
+        void addVitals(int maxHealth, float cooldownTime, vec3 color) {
+            entities->health.add(entity, Health { maxHealth, maxHealth });
+            entities->cooldowns.add(entity, Cooldown { cooldownTime, cooldownTime, 0, false, false });
+            entities->tints.add(entity, Tint { color, FLASH_COLOR, color });
+        }
+
+        /**
+         * Collision filter for the entity's particles. Unless isSelfColliding, the entity's
+         * particles are grouped by its id and never collide with each other.
+         */
+        CollisionFilter collisionFilter(unsigned int layer, unsigned int mask, bool isSelfColliding) {
+            if (isSelfColliding) return CollisionFilter(layer, mask);
+            return CollisionFilter(layer, mask, entity);
+        }
+
+        /**
+         * Full health, no cooldown and the base colour again, for an entity spawned anew.
+         */
+        void resetVitals() {
+            Health &health = this->health();
+            health.current = health.max;
+
+            Cooldown &cooldown = this->cooldown();
+            cooldown = Cooldown { cooldown.duration, cooldown.duration, 0, false, false };
+
+            Tint &tint = entities->tints.get(entity);
+            tint.current = tint.base;
+        }
+
+        EntityStore *entities;
+        Entity entity;
+        int objectId;
 
         // bizzare bug on Devin's Linux, without these 3 extra unused fields, screen will stay on background
         float a;
         float b;
         float c;
+
+    private:
+        const vec3 FLASH_COLOR = vec3(1.0f, 0.0f, 0.0f);
 };
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef GAME_RANDOM_H
+#define GAME_RANDOM_H
+
+/**
+ * Small linear congruential generator. The game draws spawns from one of its own, on the game
+ * thread only, and every enemy draws from its own (see Steering), so no generator is shared
+ * between threads and a seeded game replays the same. Plain data, so it is saved with
+ * snapshots.
+ */
+struct GameRandom {
+    unsigned int state;
+
+    /**
+     * Random integer in [0, n).
+     */
+    int next(int n) {
+        return (nextSeed() >> 8) % n;
+    }
+
+    /**
+     * Full 32 bits, e.g. to seed another generator.
+     */
+    unsigned int nextSeed() {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef GAME_WORLD_H
+#define GAME_WORLD_H
+
+#include "bullet.h"
+#include "centipede.h"
+#include "emu.h"
+#include "enemy_ai.h"
+#include "entity_recycler.h"
+#include "entity_store.h"
+#include "job_system.h"
+#include "physics_manager.h"
+#include "player.h"
+#include "player_input.h"
+#include "game_random.h"
+
+#include "VecMat.h"
+
+#include <vector>
+
+/**
+ * The simulated game: physics, the player, enemies and bullets, advanced in fixed steps from a
+ * PlayerInput. It uses no window or GL context, so it runs the same under Game, which draws it,
+ * and headless (see runHeadless).
+ */
+class GameWorld {
+public:
+    /**
+     * Seeds the game's random generator, which places spawns and seeds each enemy's own
+     * generator, so two worlds with the same seed and input play out the same.
+     */
+    GameWorld(unsigned int seed)
+        : emuRecycler(&pm, &entities)
+        , centipedeRecycler(&pm, &entities)
+        , bulletRecycler(&pm, &entities)
+    {
+        random.state = seed;
+
+        player = new Player(&pm, &entities, vec3(0, 0, 0));
+    }
+
+    GameWorld(const GameWorld&) = delete;
+    GameWorld &operator=(const GameWorld&) = delete;
+
+    /**
+     * Run the simulation in fixed steps for a frame of the given length, however long it took.
+     * Every step holds the controls down as given; the cursor movement is applied once, and
+     * carried over to the next frame if this one runs no step.
+     */
+    void update(double timeDelta, const PlayerInput &controls) {
+        PlayerInput stepControls = controls;
+        stepControls.lookX += pendingLookX;
+        stepControls.lookY += pendingLookY;
+
+        int steps = pm.beginFrame(timeDelta);
+        pendingLookX = steps > 0 ? 0 : stepControls.lookX;
+        pendingLookY = steps > 0 ? 0 : stepControls.lookY;
+        for (int i = 0; i < steps; i++) {
+            tick(pm.getStepTime(), stepControls);
+            stepControls.lookX = 0;
+            stepControls.lookY = 0;
+        }
+    }
+
+    /**
+     * Advance the game by one physics step.
+     */
+    void tick(double timeDelta, const PlayerInput &controls) {
+        timeToSpawnEnemy -= timeDelta;
+        if (timeToSpawnEnemy <= 0) {
+            vec3 spawnPosition = randomSpawnPositionAwayFromPlayer();
+            if (random.next(5) < 2) {
+                centipedes.push_back(centipedeRecycler.spawn(spawnPosition));
+            } else {
+                emus.push_back(emuRecycler.spawn(spawnPosition, random.nextSeed()));
+            }
+
+            timeToSpawnEnemy = random.next(5) + 5;
+        }
+
+        // Update physics, then let entities react to the contacts it found
+        pm.update(timeDelta);
+        pm.dispatchContacts();
+
+        Bullet *bullet = player->input(controls, bulletRecycler);
+        if (bullet != nullptr) bullets.push_back(bullet);
+
+        // Update entities. Enemies steer toward the player, so it goes first. Bullets fly on
+        // physics alone.
+        player->update(timeDelta);
+        enemyAi.update(entities, emus, centipedes, player->getControllerPosition(), timeDelta, jobSystem);
+
+        // Systems shared by every kind of entity
+        entities.updateCooldowns(timeDelta);
+        player->respawnIfDown();
+
+        removeDead(emus, emuRecycler);
+        removeDead(centipedes, centipedeRecycler);
+        removeDead(bullets, bulletRecycler);
+    }
+
+    /**
+     * Spawn count emus at once, away from the player, on top of those spawned over time. Used to
+     * load headless runs.
+     */
+    void spawnEmus(int count) {
+        for (int i = 0; i < count; i++) {
+            emus.push_back(emuRecycler.spawn(randomSpawnPositionAwayFromPlayer(), random.nextSeed()));
+        }
+    }
+
+    /**
+     * Save the spawn timer, the game's random generator, the simulation and every entity into
+     * buffer as one flat blob, without changing the world. See PhysicsManager::saveSnapshot.
+     */
+    void saveSnapshot(std::vector<unsigned char> &buffer) {
+        buffer.clear();
+        SnapshotWriter writer(buffer);
+        writer.write(timeToSpawnEnemy);
+        writer.write(random);
+        pm.saveSnapshot(writer);
+    }
+
+    /**
+     * Restore a snapshot, e.g. to roll back a few steps. The snapshot holds the state of the
+     * entities but not the entities themselves, so it can only be restored while exactly the
+     * same entities exist as when it was saved: an enemy or bullet spawned or removed since
+     * cannot be brought back or taken away. Returns false and changes nothing if they differ.
+     * After a restore, the world plays out as it did after the save, given the same input.
+     */
+    bool restoreSnapshot(const std::vector<unsigned char> &buffer) {
+        SnapshotReader reader(buffer);
+        float savedTimeToSpawnEnemy;
+        GameRandom savedRandom;
+        if (!reader.read(savedTimeToSpawnEnemy) || !reader.read(savedRandom) || !pm.restoreSnapshot(reader)) return false;
+
+        timeToSpawnEnemy = savedTimeToSpawnEnemy;
+        random = savedRandom;
+        return true;
+    }
+
+    PhysicsManager &getPhysics() { return pm; }
+    Player* getPlayer() { return player; }
+    int getEmuCount() { return emus.size(); }
+    int getCentipedeCount() { return centipedes.size(); }
+    int getBulletCount() { return bullets.size(); }
+
+private:
+    vec3 randomSpawnPosition() {
+        int x = random.next(40) - 20;
+        int z = random.next(40) - 20;
+        return vec3(x, 0, z);
+    }
+
+    vec3 randomSpawnPositionAwayFromPlayer() {
+        vec3 spawnPosition = randomSpawnPosition();
+        while (length(spawnPosition - player->getControllerPosition()) < 5) {
+            spawnPosition = randomSpawnPosition();
+        }
+        return spawnPosition;
+    }
+
+    /**
+     * Hand dead entities of one kind to their recycler, which takes their particles and springs
+     * out of the simulation until the next spawn.
+     */
+    template <typename T>
+    void removeDead(std::vector<T*> &objects, EntityRecycler<T> &recycler) {
+        for (int i = objects.size() - 1; i >= 0; i--) {
+            if (objects[i]->isDead()) {
+                recycler.recycle(objects[i]);
+                objects[i] = objects.back();
+                objects.pop_back();
+            }
+        }
+    }
+
+    JobSystem &jobSystem = JobSystem::getShared();
+    EntityStore entities;
+    EnemyAi enemyAi;
+    PhysicsManager pm;
+
+    Player *player;
+    std::vector<Emu*> emus;
+    std::vector<Centipede*> centipedes;
+    std::vector<Bullet*> bullets;
+
+    // Dead entities waiting to be spawned again
+    EntityRecycler<Emu> emuRecycler;
+    EntityRecycler<Centipede> centipedeRecycler;
+    EntityRecycler<Bullet> bulletRecycler;
+
+    // Only used on the game thread
+    GameRandom random;
+    float timeToSpawnEnemy = 5;
+    float pendingLookX = 0;
+    float pendingLookY = 0;
+};
+
+#endif
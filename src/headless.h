@@ -0,0 +1,117 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "game_world.h"
+#include "player_input.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Runs the game without a window or GL context, for soak tests, tuning and benchmarks on
+ * machines without a GPU. A GameWorld is stepped a fixed number of ticks as fast as the CPU
+ * allows, with the player driven by a simple script or left idle, and a summary is printed as
+ * CSV: wall time, ticks per second, entities alive at the end, how many steps had enough pairs
+ * or springs to run in parallel, and a hash of the final physics state.
+ *
+ * Usage: sproin_headless [options], or sproinGL --headless [options]
+ *   --ticks N          physics steps to run (default 36000, ten minutes of game time)
+ *   --seed N           seed for spawns and enemy targets (default 1)
+ *   --workers N        worker threads besides the caller (default all cores)
+ *   --emus N           emus to spawn at the start, on top of the usual spawns (default 0)
+ *   --idle             leave the player standing instead of running the script
+ *
+ * Every tick is one fixed physics step, and the parallel passes give the same results on any
+ * number of workers, so runs with the same options end with the same hash whatever --workers.
+ * That only says something about the parallel passes if the run used them: a few hundred emus
+ * are needed for that.
+ */
+
+struct HeadlessOptions {
+    int ticks = 36000;
+    unsigned int seed = 1;
+    int workers = -1;
+    int emus = 0;
+    bool isIdle = false;
+};
+
+/**
+ * Controls of the scripted player: run forward while turning in a wide circle, jump every 4 s
+ * and fire twice a second.
+ */
+inline PlayerInput scriptedInput(int tick) {
+    PlayerInput controls;
+    controls.isForward = true;
+    controls.lookX = 2;
+    controls.isJumping = tick % 240 == 0;
+    controls.isFiring = tick % 30 < 2;
+    return controls;
+}
+
+inline bool parseHeadlessOptions(int argc, char **argv, HeadlessOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg == "--headless") continue;
+        if (arg == "--idle") {
+            options.isIdle = true;
+            continue;
+        }
+        if (value == nullptr) return false;
+        i++;
+
+        if (arg == "--ticks") {
+            options.ticks = atoi(value);
+        } else if (arg == "--seed") {
+            options.seed = strtoul(value, nullptr, 10);
+        } else if (arg == "--workers") {
+            options.workers = atoi(value);
+        } else if (arg == "--emus") {
+            options.emus = atoi(value);
+        } else {
+            return false;
+        }
+    }
+    return options.ticks >= 0 && options.emus >= 0;
+}
+
+inline int runHeadless(int argc, char **argv) {
+    HeadlessOptions options;
+    if (!parseHeadlessOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--headless] [--ticks n] [--seed n] [--workers n] [--emus n] [--idle]\n", argv[0]);
+        return 2;
+    }
+
+    GameWorld world(options.seed);
+    PhysicsManager &pm = world.getPhysics();
+    if (options.workers >= 0) pm.setWorkerCount(options.workers);
+    world.spawnEmus(options.emus);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PlayerInput idle;
+    int parallelPairSteps = 0;
+    int parallelSpringSteps = 0;
+    for (int tick = 0; tick < options.ticks; tick++) {
+        // No camera, so level of detail goes by distance from the player alone
+        pm.setLodFocus(world.getPlayer()->getControllerPosition());
+        world.tick(pm.getStepTime(), options.isIdle ? idle : scriptedInput(tick));
+
+        PhysicsStats stats = pm.getStats();
+        if (stats.candidatePairCount >= Narrowphase::PARALLEL_THRESHOLD) parallelPairSteps++;
+        if (stats.activeSpringCount >= SpringSolver::PARALLEL_THRESHOLD) parallelSpringSteps++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("ticks,seed,seconds,ticks_per_second,emus,centipedes,bullets,particles,player_health,parallel_pair_steps,parallel_spring_steps,hash\n");
+    printf("%d,%u,%.3f,%.1f,%d,%d,%d,%d,%d,%d,%d,%016llx\n",
+           options.ticks, options.seed, seconds, seconds > 0 ? options.ticks / seconds : 0.0,
+           world.getEmuCount(), world.getCentipedeCount(), world.getBulletCount(),
+           pm.getParticleCount(), world.getPlayer()->getHealth(), parallelPairSteps, parallelSpringSteps,
+           pm.stateHash());
+    return 0;
+}
+
+#endif
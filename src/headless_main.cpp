@@ -0,0 +1,8 @@
+#include "headless.h"
+
+/**
+ * The game without a window, linked without GLFW, GLAD or OpenGL. See headless.h.
+ */
+int main(int argc, char **argv) {
+    return runHeadless(argc, argv);
+}
@@ -0,0 +1,251 @@
+#ifndef IMPLICIT_SOLVER_H
+#define IMPLICIT_SOLVER_H
+
+#include "particle_store.h"
+#include "spring.h"
+
+#include "VecMat.h"
+
+#include <math.h>
+#include <vector>
+
+/**
+ * Backward Euler integration of the spring network (Baraff and Witkin). Each step linearises
+ * the spring forces around the current state and solves
+ *
+ *     (M + h C + h^2 K) dv = h (f + h K v)
+ *
+ * for the velocity change, where C and K are the damping and stiffness Jacobians of the
+ * springs. The system is stored as one 3x3 block per particle on the diagonal plus one
+ * off-diagonal block per spring, and solved with conjugate gradient preconditioned by the
+ * inverted diagonal blocks. The step length h is measured in 60 Hz steps, the unit the explicit
+ * path uses for velocities and forces, so one implicit step can replace several explicit ones.
+ */
+class ImplicitSolver {
+public:
+    ImplicitSolver() {
+    }
+
+    /**
+     * Pack endpoint indices and constants of the given springs. Must be called again whenever
+     * springs are added or removed or particles move to other indices.
+     */
+    void pack(const std::vector<Spring*> &springs) {
+        int count = springs.size();
+        index1.resize(count);
+        index2.resize(count);
+        targetLength.resize(count);
+        stiffness.resize(count);
+        damping.resize(count);
+
+        for (int i = 0; i < count; i++) {
+            index1[i] = springs[i]->getParticle1()->getIndex();
+            index2[i] = springs[i]->getParticle2()->getIndex();
+            targetLength[i] = springs[i]->getTargetLength();
+            stiffness[i] = springs[i]->getStiffness();
+            damping[i] = springs[i]->getDamping();
+        }
+
+        offDiagonal.resize(count);
+    }
+
+    /**
+     * Find every awake particle's velocity at the end of a step of length h times its own step
+     * length, from gravity, the accumulated forces and the implicit spring response. Positions are then advanced with
+     * ParticleStore::advancePositions. Returns the number of conjugate gradient iterations used.
+     */
+    int updateVelocities(ParticleStore &store, float gravityStrength, float h=1) {
+        int count = store.size();
+        assemble(store, gravityStrength, h);
+
+        int iterations = solve(count);
+
+        for (int i = 0; i < count; i++) {
+            if (!isFree[i]) continue;
+            store.velocity[i] += deltaVelocity[i];
+        }
+        return iterations;
+    }
+
+    void setTolerance(float tolerance, int maxIterations) {
+        this->tolerance = tolerance;
+        this->maxIterations = maxIterations;
+    }
+
+private:
+    const float DEFAULT_TOLERANCE = 0.0001f;
+    const int DEFAULT_MAX_ITERATIONS = 50;
+
+    /**
+     * Build the diagonal and off-diagonal blocks and the right-hand side. Sleeping and
+     * force-exempt particles are held fixed: their rows are left out of the solve.
+     */
+    void assemble(const ParticleStore &store, float gravityStrength, float h) {
+        int count = store.size();
+        diagonal.resize(count);
+        rightHandSide.resize(count);
+        isFree.resize(count);
+
+        for (int i = 0; i < count; i++) {
+            isFree[i] = !store.asleep[i] && !store.isForceExempt[i];
+            diagonal[i] = mat3(store.mass[i]);
+            rightHandSide[i] = isFree[i] ? (store.netForce[i] + vec3(0.0f, -gravityStrength, 0.0f)) * (h * store.stepLength[i]) : vec3(0.0f, 0.0f, 0.0f);
+        }
+
+        for (int s = 0; s < index1.size(); s++) {
+            int i = index1[s], j = index2[s];
+
+            // Springs between two held particles, e.g. of an island that skips this step, change
+            // nothing in the solve
+            vec3 delta = store.position[j] - store.position[i];
+            float length = sqrtf(dot(delta, delta));
+            if ((!isFree[i] && !isFree[j]) || length <= 0) {
+                offDiagonal[s] = mat3(0.0f);
+                continue;
+            }
+            vec3 n = delta / length;
+
+            // Stiffness Jacobian block; the transverse term is clamped so compressed springs
+            // cannot make the system indefinite
+            float transverse = 1.0f - targetLength[s] / length;
+            if (transverse < 0) transverse = 0;
+            mat3 outer = outerProduct(n, n);
+            mat3 jacobian = add(outer * (stiffness[s] * (1.0f - transverse)), mat3(stiffness[s] * transverse));
+
+            // Explicit spring force plus the h K v term, over the step length of the spring's island
+            float hs = h * store.stepLength[i];
+            vec3 relativeVelocity = store.velocity[j] - store.velocity[i];
+            vec3 force = n * (stiffness[s] * (length - targetLength[s])) + relativeVelocity * damping[s];
+            vec3 rhs = (force + jacobian * relativeVelocity * hs) * hs;
+            if (isFree[i]) rightHandSide[i] += rhs;
+            if (isFree[j]) rightHandSide[j] -= rhs;
+
+            mat3 block = add(jacobian * (hs * hs), mat3(damping[s] * hs));
+            diagonal[i] = add(diagonal[i], block);
+            diagonal[j] = add(diagonal[j], block);
+            offDiagonal[s] = block * -1.0f;
+        }
+
+        preconditioner.resize(count);
+        for (int i = 0; i < count; i++) {
+            preconditioner[i] = isFree[i] ? inverse(diagonal[i]) : mat3(0.0f);
+        }
+    }
+
+    /**
+     * Preconditioned conjugate gradient for the velocity change.
+     */
+    int solve(int count) {
+        deltaVelocity.assign(count, vec3(0.0f, 0.0f, 0.0f));
+        residual = rightHandSide;
+        preconditioned.resize(count);
+        direction.resize(count);
+        product.resize(count);
+
+        float rhsNorm = 0;
+        for (int i = 0; i < count; i++) {
+            rhsNorm += dot(rightHandSide[i], rightHandSide[i]);
+        }
+        if (rhsNorm == 0) return 0;
+
+        float rho = 0;
+        for (int i = 0; i < count; i++) {
+            preconditioned[i] = preconditioner[i] * residual[i];
+            direction[i] = preconditioned[i];
+            rho += dot(residual[i], preconditioned[i]);
+        }
+
+        int iteration = 0;
+        for (; iteration < maxIterations; iteration++) {
+            multiply(direction, product);
+
+            float directionProduct = 0;
+            for (int i = 0; i < count; i++) {
+                directionProduct += dot(direction[i], product[i]);
+            }
+            if (directionProduct <= 0) break;
+
+            float alpha = rho / directionProduct;
+            float residualNorm = 0;
+            for (int i = 0; i < count; i++) {
+                deltaVelocity[i] += direction[i] * alpha;
+                residual[i] -= product[i] * alpha;
+                residualNorm += dot(residual[i], residual[i]);
+            }
+            if (residualNorm <= tolerance * tolerance * rhsNorm) {
+                iteration++;
+                break;
+            }
+
+            float nextRho = 0;
+            for (int i = 0; i < count; i++) {
+                preconditioned[i] = preconditioner[i] * residual[i];
+                nextRho += dot(residual[i], preconditioned[i]);
+            }
+            float beta = nextRho / rho;
+            rho = nextRho;
+            for (int i = 0; i < count; i++) {
+                direction[i] = preconditioned[i] + direction[i] * beta;
+            }
+        }
+
+        return iteration;
+    }
+
+    /**
+     * Block-sparse matrix times vector, with the rows of fixed particles zeroed.
+     */
+    void multiply(const std::vector<vec3> &x, std::vector<vec3> &y) {
+        int count = x.size();
+        for (int i = 0; i < count; i++) {
+            y[i] = diagonal[i] * x[i];
+        }
+        for (int s = 0; s < index1.size(); s++) {
+            int i = index1[s], j = index2[s];
+            y[i] += offDiagonal[s] * x[j];
+            y[j] += offDiagonal[s] * x[i];
+        }
+        for (int i = 0; i < count; i++) {
+            if (!isFree[i]) y[i] = vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    static mat3 outerProduct(const vec3 &a, const vec3 &b) {
+        return mat3(b * a.x, b * a.y, b * a.z);
+    }
+
+    static mat3 add(const mat3 &a, const mat3 &b) {
+        return mat3(a[0] + b[0], a[1] + b[1], a[2] + b[2]);
+    }
+
+    static mat3 inverse(const mat3 &m) {
+        vec3 c0 = cross(m[1], m[2]);
+        vec3 c1 = cross(m[2], m[0]);
+        vec3 c2 = cross(m[0], m[1]);
+        float determinant = dot(m[0], c0);
+        if (determinant == 0) return mat3(0.0f);
+
+        // Rows of the inverse are the columns of the cofactor vectors
+        float r = 1.0f / determinant;
+        return mat3(vec3(c0.x, c1.x, c2.x) * r, vec3(c0.y, c1.y, c2.y) * r, vec3(c0.z, c1.z, c2.z) * r);
+    }
+
+    float tolerance = DEFAULT_TOLERANCE;
+    int maxIterations = DEFAULT_MAX_ITERATIONS;
+
+    std::vector<int> index1, index2;
+    std::vector<float> targetLength;
+    std::vector<float> stiffness;
+    std::vector<float> damping;
+
+    std::vector<mat3> diagonal;
+    std::vector<mat3> offDiagonal;
+    std::vector<mat3> preconditioner;
+    std::vector<unsigned char> isFree;
+
+    std::vector<vec3> rightHandSide;
+    std::vector<vec3> deltaVelocity;
+    std::vector<vec3> residual, preconditioned, direction, product;
+};
+
+#endif
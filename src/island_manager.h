@@ -0,0 +1,195 @@
+#ifndef ISLAND_MANAGER_H
+#define ISLAND_MANAGER_H
+
+#include "particle_store.h"
+#include "snapshot.h"
+#include "spring.h"
+
+#include "VecMat.h"
+
+#include <vector>
+
+/**
+ * Groups particles into islands connected by springs, usually one island per entity, and puts
+ * an island to sleep once all of its particles have been nearly still for a while. Sleeping
+ * particles are flagged in the ParticleStore so the physics passes can skip them.
+ */
+class IslandManager {
+public:
+    IslandManager() {
+    }
+
+    /**
+     * Find the islands with a union-find over the springs. Particles keep their sleep state, and
+     * an island that mixes sleeping and awake particles is woken as a whole.
+     */
+    void rebuild(ParticleStore &store, const std::vector<Spring*> &springs) {
+        int count = store.size();
+
+        parent.resize(count);
+        for (int i = 0; i < count; i++) {
+            parent[i] = i;
+        }
+        for (int i = 0; i < springs.size(); i++) {
+            int root1 = find(springs[i]->getParticle1()->getIndex());
+            int root2 = find(springs[i]->getParticle2()->getIndex());
+            if (root1 < root2) parent[root2] = root1;
+            else parent[root1] = root2;
+        }
+
+        // Number islands in order of their lowest particle index
+        int islandCount = 0;
+        for (int i = 0; i < count; i++) {
+            int root = find(i);
+            store.island[i] = root == i ? islandCount++ : store.island[root];
+        }
+
+        islandStart.assign(islandCount + 1, 0);
+        for (int i = 0; i < count; i++) {
+            islandStart[store.island[i] + 1]++;
+        }
+        for (int k = 0; k < islandCount; k++) {
+            islandStart[k + 1] += islandStart[k];
+        }
+        std::vector<int> fill(islandStart.begin(), islandStart.end() - 1);
+        islandParticles.resize(count);
+        for (int i = 0; i < count; i++) {
+            islandParticles[fill[store.island[i]]++] = i;
+        }
+
+        sleepCounter.assign(islandCount, 0);
+        isAsleep.assign(islandCount, true);
+        for (int i = 0; i < count; i++) {
+            if (!store.asleep[i]) isAsleep[store.island[i]] = false;
+        }
+        for (int k = 0; k < islandCount; k++) {
+            if (!isAsleep[k]) setAsleep(store, k, false);
+        }
+    }
+
+    /**
+     * Wake the islands of particles that game code pushed, moved or collided with.
+     * Returns true if any island woke up.
+     */
+    bool processWakeRequests(ParticleStore &store) {
+        bool isAnyWoken = false;
+        for (int i = 0; i < store.wakeRequests.size(); i++) {
+            isAnyWoken |= wake(store, store.island[store.wakeRequests[i]]);
+        }
+        store.wakeRequests.clear();
+        return isAnyWoken;
+    }
+
+    /**
+     * Wake an island. Returns true if it was asleep.
+     */
+    bool wake(ParticleStore &store, int island) {
+        if (island < 0 || !isAsleep[island]) return false;
+
+        setAsleep(store, island, false);
+        sleepCounter[island] = 0;
+        return true;
+    }
+
+    /**
+     * Count how long each awake island has stayed below the kinetic energy threshold and put
+     * it to sleep after sleepSteps steps. Returns true if any island fell asleep.
+     */
+    bool updateSleep(ParticleStore &store, float energyThreshold, int sleepSteps) {
+        bool isAnyAsleep = false;
+
+        for (int k = 0; k < isAsleep.size(); k++) {
+            if (isAsleep[k]) continue;
+
+            float maxEnergy = 0;
+            for (int n = islandStart[k]; n < islandStart[k + 1]; n++) {
+                int i = islandParticles[n];
+                float energy = 0.5f * store.mass[i] * dot(store.velocity[i], store.velocity[i]);
+                if (energy > maxEnergy) maxEnergy = energy;
+            }
+
+            if (maxEnergy >= energyThreshold) {
+                sleepCounter[k] = 0;
+            } else if (++sleepCounter[k] >= sleepSteps) {
+                setAsleep(store, k, true);
+                for (int n = islandStart[k]; n < islandStart[k + 1]; n++) {
+                    store.velocity[islandParticles[n]] = vec3(0, 0, 0);
+                }
+                isAnyAsleep = true;
+            }
+        }
+
+        return isAnyAsleep;
+    }
+
+    /**
+     * Write how long each particle's island has been still, as an array with one value per
+     * particle. Islands themselves are rebuilt from the springs, so a restore must rebuild
+     * before reading the timers back; the islands must be up to date when saving.
+     */
+    void saveSleepTimers(const ParticleStore &store, SnapshotWriter &writer) const {
+        writer.write(store.size());
+        for (int i = 0; i < store.size(); i++) {
+            writer.write(sleepCounter[store.island[i]]);
+        }
+    }
+
+    bool restoreSleepTimers(const ParticleStore &store, SnapshotReader &reader) {
+        int count;
+        if (!reader.read(count) || count != store.size()) return false;
+        for (int i = 0; i < count; i++) {
+            if (!reader.read(sleepCounter[store.island[i]])) return false;
+        }
+        return true;
+    }
+
+    int getIslandCount() const { return isAsleep.size(); }
+    bool isIslandAsleep(int island) const { return isAsleep[island]; }
+
+    /**
+     * The particles of island k are getIslandParticles()[n] for n from getIslandStart(k) up to
+     * getIslandStart(k + 1).
+     */
+    const std::vector<int> &getIslandParticles() const { return islandParticles; }
+    int getIslandStart(int island) const { return islandStart[island]; }
+
+    int getSleepingCount() {
+        int sleeping = 0;
+        for (int k = 0; k < isAsleep.size(); k++) {
+            if (isAsleep[k]) sleeping++;
+        }
+        return sleeping;
+    }
+
+    int getSleepingParticleCount() const {
+        int sleeping = 0;
+        for (int k = 0; k < isAsleep.size(); k++) {
+            if (isAsleep[k]) sleeping += islandStart[k + 1] - islandStart[k];
+        }
+        return sleeping;
+    }
+
+private:
+    int find(int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void setAsleep(ParticleStore &store, int island, bool asleep) {
+        isAsleep[island] = asleep;
+        for (int n = islandStart[island]; n < islandStart[island + 1]; n++) {
+            store.asleep[islandParticles[n]] = asleep;
+        }
+    }
+
+    std::vector<int> parent;
+    std::vector<int> islandStart;
+    std::vector<int> islandParticles;
+    std::vector<int> sleepCounter;
+    std::vector<unsigned char> isAsleep;
+};
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+/**
+ * Counts the unfinished jobs submitted against it. Jobs may be made to depend on a counter, in
+ * which case they only start once it reaches zero. A counter must not be destroyed before
+ * JobSystem::wait has returned for it.
+ */
+class JobCounter {
+public:
+    JobCounter()
+        : value(0) { }
+
+    JobCounter(const JobCounter&) = delete;
+    JobCounter &operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return value.load() == 0; }
+
+private:
+    std::atomic<int> value;
+    std::mutex mutex;
+    std::vector<Job*> dependents;
+
+    friend class JobSystem;
+};
+
+struct Job {
+    std::function<void()> task;
+    JobCounter *counter;
+};
+
+/**
+ * Fixed set of worker threads that run jobs from per-worker queues. A worker takes its own
+ * newest job first and, when it runs out, steals the oldest job of another queue. Threads that
+ * are not workers submit to a shared queue and, while they wait for a counter, run queued jobs
+ * themselves, so a system with no workers still makes progress and runs every job on the
+ * waiting thread.
+ *
+ * Physics, entity updates and asset loading all share one system (see getShared) so their
+ * threads never compete for the same cores.
+ */
+class JobSystem {
+public:
+    typedef std::function<void()> Task;
+
+    JobSystem(int workerCount=defaultWorkerCount()) {
+        queuedJobs = 0;
+        sleepingWorkers = 0;
+        start(workerCount);
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem &operator=(const JobSystem&) = delete;
+
+    ~JobSystem() {
+        stop();
+    }
+
+    /**
+     * Replace the worker threads. Must only be called while no jobs are queued or running.
+     */
+    void setWorkerCount(int workerCount) {
+        stop();
+        start(workerCount);
+    }
+
+    int getWorkerCount() { return threads.size(); }
+
+    /**
+     * Queue task to run on any thread. The job is counted against counter, if given, until it
+     * has finished, and does not start before dependency, if given, has reached zero.
+     */
+    void run(Task task, JobCounter *counter=nullptr, JobCounter *dependency=nullptr) {
+        Job *job = new Job();
+        job->task = std::move(task);
+        job->counter = counter;
+        if (counter != nullptr) counter->value++;
+
+        if (dependency != nullptr) {
+            std::unique_lock<std::mutex> lock(dependency->mutex);
+            if (dependency->value.load() > 0) {
+                dependency->dependents.push_back(job);
+                return;
+            }
+        }
+
+        submit(job);
+    }
+
+    /**
+     * Return once every job counted against counter has finished, running queued jobs on the
+     * calling thread in the meantime.
+     */
+    void wait(JobCounter &counter) {
+        int self = currentQueue();
+        while (counter.value.load() > 0) {
+            Job *job = takeJob(self);
+            if (job != nullptr) execute(job);
+            else std::this_thread::yield();
+        }
+
+        // The last job may still be releasing the counter's dependents
+        std::unique_lock<std::mutex> lock(counter.mutex);
+    }
+
+    /**
+     * Split [0, count) into chunks of at most grainSize and call task(begin, end) on each chunk.
+     * The calling thread takes part, and the call returns once every chunk has run.
+     */
+    void parallelFor(int count, int grainSize, const std::function<void(int, int)> &task) {
+        if (count <= 0) return;
+
+        int chunkCount = (count + grainSize - 1) / grainSize;
+        if (threads.empty() || chunkCount == 1) {
+            task(0, count);
+            return;
+        }
+
+        std::atomic<int> nextChunk(0);
+        std::function<void()> runChunks = [&] {
+            while (true) {
+                int chunk = nextChunk++;
+                if (chunk >= chunkCount) return;
+
+                int begin = chunk * grainSize;
+                int end = begin + grainSize < count ? begin + grainSize : count;
+                task(begin, end);
+            }
+        };
+
+        // One job per worker that can usefully join in; each claims chunks until none are left
+        JobCounter counter;
+        int helperCount = chunkCount - 1 < getWorkerCount() ? chunkCount - 1 : getWorkerCount();
+        for (int i = 0; i < helperCount; i++) {
+            run(runChunks, &counter);
+        }
+
+        runChunks();
+        wait(counter);
+    }
+
+    /**
+     * One worker per hardware thread besides the calling thread.
+     */
+    static int defaultWorkerCount() {
+        int hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    /**
+     * The system shared by the whole game.
+     */
+    static JobSystem &getShared() {
+        static JobSystem shared;
+        return shared;
+    }
+
+private:
+    /**
+     * Jobs of one thread. Padded so neighbouring queues do not share a cache line.
+     */
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job*> jobs;
+        char padding[64];
+    };
+
+    struct ThreadSlot {
+        JobSystem *system;
+        int queue;
+    };
+
+    static ThreadSlot &currentSlot() {
+        static thread_local ThreadSlot slot = { nullptr, -1 };
+        return slot;
+    }
+
+    /**
+     * Queue of the calling thread: its own for a worker, the shared one for any other thread.
+     */
+    int currentQueue() {
+        ThreadSlot &slot = currentSlot();
+        return slot.system == this ? slot.queue : sharedQueue();
+    }
+
+    int sharedQueue() { return queues.size() - 1; }
+
+    void start(int workerCount) {
+        isStopping = false;
+        for (int i = 0; i < workerCount + 1; i++) {
+            queues.push_back(new Queue());
+        }
+        for (int i = 0; i < workerCount; i++) {
+            threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+        }
+    }
+
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            isStopping = true;
+        }
+        wake.notify_all();
+
+        for (int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        threads.clear();
+
+        for (int i = 0; i < queues.size(); i++) {
+            delete queues[i];
+        }
+        queues.clear();
+    }
+
+    void submit(Job *job) {
+        // Without workers nobody else would ever run it
+        if (threads.empty()) {
+            execute(job);
+            return;
+        }
+
+        Queue &queue = *queues[currentQueue()];
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+
+        queuedJobs++;
+        if (sleepingWorkers.load() > 0) {
+            // Taking the lock orders this wake after a worker that is about to sleep has started waiting
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            lock.unlock();
+            wake.notify_one();
+        }
+    }
+
+    /**
+     * Take the newest job of the thread's own queue, or else the oldest job of the shared
+     * queue or another worker's queue.
+     */
+    Job* takeJob(int self) {
+        Job *job = nullptr;
+        if (self != sharedQueue()) job = popNewest(*queues[self]);
+        if (job == nullptr) job = popOldest(*queues[sharedQueue()]);
+
+        int workerCount = sharedQueue();
+        for (int i = 1; job == nullptr && i <= workerCount; i++) {
+            int victim = (self + i) % (workerCount + 1);
+            if (victim != sharedQueue()) job = popOldest(*queues[victim]);
+        }
+
+        if (job != nullptr) queuedJobs--;
+        return job;
+    }
+
+    static Job* popNewest(Queue &queue) {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) return nullptr;
+        Job *job = queue.jobs.back();
+        queue.jobs.pop_back();
+        return job;
+    }
+
+    static Job* popOldest(Queue &queue) {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) return nullptr;
+        Job *job = queue.jobs.front();
+        queue.jobs.pop_front();
+        return job;
+    }
+
+    void execute(Job *job) {
+        job->task();
+        JobCounter *counter = job->counter;
+        delete job;
+
+        if (counter != nullptr) finish(*counter);
+    }
+
+    /**
+     * Count one job of counter as done, and release the jobs waiting on it if it was the last.
+     */
+    void finish(JobCounter &counter) {
+        std::vector<Job*> released;
+        {
+            std::unique_lock<std::mutex> lock(counter.mutex);
+            if (--counter.value == 0) released.swap(counter.dependents);
+        }
+
+        for (int i = 0; i < released.size(); i++) {
+            submit(released[i]);
+        }
+    }
+
+    void workerLoop(int index) {
+        ThreadSlot &slot = currentSlot();
+        slot.system = this;
+        slot.queue = index;
+
+        while (true) {
+            Job *job = takeJob(index);
+            if (job != nullptr) {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers++;
+            wake.wait(lock, [this] { return isStopping || queuedJobs.load() > 0; });
+            sleepingWorkers--;
+            if (isStopping) return;
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<Queue*> queues;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queuedJobs;
+    std::atomic<int> sleepingWorkers;
+    bool isStopping = false;
+};
+
+#endif
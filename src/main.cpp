@@ -1,9 +1,17 @@
 #include "game.h"
+#include "headless.h"
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
 
-int main() {
+#include <string.h>
+
+int main(int argc, char **argv) {
+    // Simulate without opening a window (see headless.h)
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) return runHeadless(argc, argv);
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
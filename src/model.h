@@ -16,15 +16,28 @@ public:
     };
 
     bool read(const char *meshName) {
+        if (!load(meshName)) return false;
+
+        buffer();
+        return true;
+    }
+
+    /**
+     * Parse the mesh file into memory. Makes no GL calls, so models can load on any thread;
+     * call buffer() on the GL thread afterwards.
+     */
+    bool load(const char *meshName) {
         if (!ReadAsciiObj(meshName, points, triangles, &normals, &uvs)) {
             printf("can't read %s\n", meshName);
             return false;
         }
 
-        buffer();
         return true;
     }
 
+    /**
+     * Upload the loaded mesh to GL buffers.
+     */
     void buffer() {
         int pointsSize = points.size() * sizeof(vec3);
         int normalsSize = normals.size() * sizeof(vec3);
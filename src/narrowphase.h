@@ -0,0 +1,285 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "broadphase.h"
+#include "contact.h"
+#include "job_system.h"
+#include "particle.h"
+#include "particle_store.h"
+
+#include "VecMat.h"
+
+#include <algorithm>
+#include <math.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Tests candidate pairs for contact and applies the bounce forces. Large pair lists are split
+ * into a fixed number of lanes of consecutive pairs. The first lane adds its forces straight to
+ * the ParticleStore; every other lane accumulates into a private force buffer, and the buffers
+ * are then merged in lane order. The lanes do not depend on the number of worker threads, so
+ * every particle sums its forces in the same order and results are bit-identical whatever the
+ * thread count.
+ */
+class Narrowphase {
+public:
+    // Fewer pairs than this are collided on one lane
+    static const int PARALLEL_THRESHOLD = 4096;
+
+    Narrowphase() {
+    }
+
+    /**
+     * Collide the given pairs. Contacts are returned in pair order. Particles of touching pairs
+     * where either particle is asleep are appended to woken, so their islands can be woken.
+     * Sleep state is read as it was at the start of the pass.
+     */
+    void collide(ParticleStore &store, const std::vector<std::pair<int, int>> &pairs,
+                 std::vector<Contact> &contacts, std::vector<int> &woken, JobSystem *jobSystem) {
+        int laneCount = pairs.size() < PARALLEL_THRESHOLD ? 1 : LANE_COUNT;
+        if (lanes.size() < laneCount) lanes.resize(laneCount);
+
+        // Buffers are zeroed as they are merged, so only newly added particles need clearing
+        int count = store.size();
+        for (int l = 1; l < laneCount; l++) {
+            lanes[l].force.resize(count, vec3(0.0f, 0.0f, 0.0f));
+            lanes[l].isTouched.resize(count, false);
+        }
+
+        if (laneCount == 1 || jobSystem == nullptr) {
+            for (int l = 0; l < laneCount; l++) {
+                collideLane(store, pairs, l, laneCount);
+            }
+        } else {
+            jobSystem->parallelFor(laneCount, 1, [&](int begin, int end) {
+                for (int l = begin; l < end; l++) {
+                    collideLane(store, pairs, l, laneCount);
+                }
+            });
+        }
+
+        contacts.clear();
+        woken.clear();
+        for (int l = 0; l < laneCount; l++) {
+            Lane &lane = lanes[l];
+            for (int k = 0; k < lane.touched.size(); k++) {
+                int i = lane.touched[k];
+                store.netForce[i] += lane.force[i];
+                lane.force[i] = vec3(0.0f, 0.0f, 0.0f);
+                lane.isTouched[i] = false;
+            }
+            contacts.insert(contacts.end(), lane.contacts.begin(), lane.contacts.end());
+            woken.insert(woken.end(), lane.woken.begin(), lane.woken.end());
+        }
+    }
+
+    /**
+     * Continuous collision for particles flagged isContinuous, run once every particle has
+     * moved. Each one is swept from its previous to its new position against every other
+     * particle it may collide with, also moving in a straight line, and stopped where it first
+     * touches one. The pair then loses its closing speed, gets the same bounce force as a
+     * discrete contact and is appended to contacts. Pairs already touching at the start of the
+     * step were handled by collide(). Particles hit while asleep are returned in woken.
+     *
+     * The broadphase still holds every particle where it was at the start of the step, so
+     * others are looked up around the swept path, widened by the furthest any particle moved.
+     */
+    void sweep(ParticleStore &store, Broadphase &broadphase, std::vector<Contact> &contacts, std::vector<int> &woken) {
+        woken.clear();
+
+        int count = store.size();
+        bool hasContinuous = false;
+        vec3 maxMotion(0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < count; i++) {
+            hasContinuous |= store.isContinuous[i] && !store.asleep[i];
+            for (int a = 0; a < 3; a++) {
+                maxMotion[a] = std::max(maxMotion[a], (float) fabs(store.position[i][a] - store.previousPosition[i][a]));
+            }
+        }
+        if (!hasContinuous) return;
+
+        for (int i = 0; i < count; i++) {
+            if (!store.isContinuous[i] || store.asleep[i]) continue;
+
+            vec3 lower, upper;
+            findSweptBounds(store, i, lower, upper);
+            broadphase.query(store, lower - maxMotion, upper + maxMotion, sweepCandidates);
+
+            int hit = -1;
+            float hitTime = 1;
+            for (int n = 0; n < sweepCandidates.size(); n++) {
+                int j = sweepCandidates[n];
+
+                // A pair of continuous particles is swept once, by the lower index
+                if (j == i || (j < i && store.isContinuous[j] && !store.asleep[j])) continue;
+                if (!store.canCollide(i, j)) continue;
+
+                float time;
+                if (findTimeOfImpact(store, i, j, time) && time <= hitTime) {
+                    hit = j;
+                    hitTime = time;
+                }
+            }
+
+            if (hit >= 0) resolveImpact(store, i, hit, hitTime, contacts, woken);
+        }
+    }
+
+private:
+    /**
+     * Results of one lane. Each lane is padded so lanes run by different threads do not share
+     * cache lines.
+     */
+    struct Lane {
+        std::vector<vec3> force;
+        std::vector<unsigned char> isTouched;
+        std::vector<int> touched;
+        std::vector<Contact> contacts;
+        std::vector<int> woken;
+        char padding[64];
+    };
+
+    static const int LANE_COUNT = 8;
+
+    void collideLane(ParticleStore &store, const std::vector<std::pair<int, int>> &pairs, int l, int laneCount) {
+        Lane &lane = lanes[l];
+        lane.touched.clear();
+        lane.contacts.clear();
+        lane.woken.clear();
+
+        int begin = (int) ((long long) pairs.size() * l / laneCount);
+        int end = (int) ((long long) pairs.size() * (l + 1) / laneCount);
+
+        for (int k = begin; k < end; k++) {
+            int i1 = pairs[k].first;
+            int i2 = pairs[k].second;
+
+            // Sleeping particles do not move, so they cannot start touching each other
+            if (store.asleep[i1] && store.asleep[i2]) continue;
+
+            // Distant islands do not collide with each other (see PhysicsLod)
+            if (store.lodLevel[i1] > 0 && store.lodLevel[i2] > 0 && store.island[i1] != store.island[i2]) continue;
+
+            vec3 delta = store.position[i2] - store.position[i1];
+            float distance = length(delta);
+
+            if (distance > 0 && distance < store.radius[i1] + store.radius[i2]) {
+                if (store.asleep[i1] || store.asleep[i2]) {
+                    lane.woken.push_back(i1);
+                    lane.woken.push_back(i2);
+                }
+
+                float bounceStrength = 0.01f / sqrt(distance);
+                vec3 bounceForce = -delta * bounceStrength;
+                if (l == 0) {
+                    store.netForce[i1] += bounceForce;
+                    store.netForce[i2] += -bounceForce;
+                } else {
+                    addForce(lane, i1, bounceForce);
+                    addForce(lane, i2, -bounceForce);
+                }
+
+                Contact contact;
+                contact.particle1 = i1;
+                contact.particle2 = i2;
+                contact.owner1 = store.handles[i1]->getOwner();
+                contact.owner2 = store.handles[i2]->getOwner();
+                contact.normal = delta / distance;
+                contact.depth = store.radius[i1] + store.radius[i2] - distance;
+                lane.contacts.push_back(contact);
+            }
+        }
+    }
+
+    /**
+     * Bounds of the sphere of particle i over its path this step.
+     */
+    static void findSweptBounds(const ParticleStore &store, int i, vec3 &lower, vec3 &upper) {
+        vec3 radius(store.radius[i], store.radius[i], store.radius[i]);
+        for (int a = 0; a < 3; a++) {
+            lower[a] = std::min(store.previousPosition[i][a], store.position[i][a]);
+            upper[a] = std::max(store.previousPosition[i][a], store.position[i][a]);
+        }
+        lower -= radius;
+        upper += radius;
+    }
+
+    /**
+     * Earliest time in (0, 1] of the step at which spheres i and j, both moving in a straight
+     * line from their previous positions, touch. False if they never touch, or touch already at
+     * the start of the step.
+     */
+    static bool findTimeOfImpact(const ParticleStore &store, int i, int j, float &time) {
+        vec3 start = store.previousPosition[j] - store.previousPosition[i];
+        vec3 motion = (store.position[j] - store.previousPosition[j]) - (store.position[i] - store.previousPosition[i]);
+        float contactDistance = store.radius[i] + store.radius[j];
+
+        // Solve |start + t motion| = contactDistance for the first t, given they start apart
+        // and close in
+        float c = dot(start, start) - contactDistance * contactDistance;
+        float b = dot(start, motion);
+        if (c <= 0 || b >= 0) return false;
+
+        float a = dot(motion, motion);
+        float discriminant = b * b - a * c;
+        if (discriminant < 0) return false;
+
+        time = (-b - sqrt(discriminant)) / a;
+        return time <= 1;
+    }
+
+    /**
+     * Move particle i back to where it touches j at the given time of the step and take away
+     * the speed at which they close in, as an inelastic impulse. Force-exempt particles are not
+     * pushed.
+     */
+    static void resolveImpact(ParticleStore &store, int i, int j, float time,
+                              std::vector<Contact> &contacts, std::vector<int> &woken) {
+        vec3 position = store.previousPosition[i] + (store.position[i] - store.previousPosition[i]) * time;
+        vec3 otherPosition = store.previousPosition[j] + (store.position[j] - store.previousPosition[j]) * time;
+        store.position[i] = position;
+
+        vec3 delta = otherPosition - position;
+        float distance = length(delta);
+        if (distance <= 0) return;
+        vec3 normal = delta / distance;
+
+        float inverseMass1 = store.isForceExempt[i] ? 0 : 1 / store.mass[i];
+        float inverseMass2 = store.isForceExempt[j] ? 0 : 1 / store.mass[j];
+        float closingSpeed = dot(store.velocity[i] - store.velocity[j], normal);
+        if (closingSpeed > 0 && inverseMass1 + inverseMass2 > 0) {
+            float impulse = closingSpeed / (inverseMass1 + inverseMass2);
+            store.velocity[i] -= normal * (impulse * inverseMass1);
+            store.velocity[j] += normal * (impulse * inverseMass2);
+        }
+
+        vec3 bounceForce = -delta * (0.01f / sqrt(distance));
+        store.netForce[i] += bounceForce;
+        store.netForce[j] += -bounceForce;
+
+        if (store.asleep[j]) woken.push_back(j);
+
+        Contact contact;
+        contact.particle1 = i;
+        contact.particle2 = j;
+        contact.owner1 = store.handles[i]->getOwner();
+        contact.owner2 = store.handles[j]->getOwner();
+        contact.normal = normal;
+        contact.depth = 0;
+        contacts.push_back(contact);
+    }
+
+    static void addForce(Lane &lane, int i, const vec3 &force) {
+        if (!lane.isTouched[i]) {
+            lane.isTouched[i] = true;
+            lane.touched.push_back(i);
+        }
+        lane.force[i] += force;
+    }
+
+    std::vector<Lane> lanes;
+    std::vector<int> sweepCandidates;
+};
+
+#endif
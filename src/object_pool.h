@@ -0,0 +1,131 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Slab allocator for objects of one type. Memory is taken in slabs of SLAB_SIZE slots, and
+ * released slots go onto a free list that the next acquire reuses first, so acquire and
+ * release are O(1) and objects of the same type sit next to each other. Slabs are kept for
+ * the life of the pool.
+ *
+ * Not thread-safe: objects are created and destroyed on the game thread only.
+ */
+template <typename T>
+class ObjectPool {
+public:
+    struct Stats {
+        int liveCount;
+        int peakCount;
+        int capacity;
+        int slabCount;
+        long long acquireCount;
+        long long releaseCount;
+    };
+
+    ObjectPool() {
+        stats = Stats();
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool &operator=(const ObjectPool&) = delete;
+
+    /**
+     * Slabs are only freed once every object has been released; objects still alive at exit
+     * keep their memory.
+     */
+    ~ObjectPool() {
+        if (stats.liveCount > 0) return;
+
+        for (int i = 0; i < slabs.size(); i++) {
+            ::operator delete(slabs[i]);
+        }
+    }
+
+    /**
+     * Uninitialized memory for one T.
+     */
+    void* acquire() {
+        if (freeList == nullptr) addSlab();
+
+        Slot *slot = freeList;
+        freeList = slot->next;
+
+        stats.acquireCount++;
+        stats.liveCount++;
+        if (stats.liveCount > stats.peakCount) stats.peakCount = stats.liveCount;
+        return slot;
+    }
+
+    /**
+     * Return memory from acquire() once its object has been destroyed.
+     */
+    void release(void *memory) {
+        Slot *slot = static_cast<Slot*>(memory);
+        slot->next = freeList;
+        freeList = slot;
+
+        stats.releaseCount++;
+        stats.liveCount--;
+    }
+
+    const Stats &getStats() const { return stats; }
+
+private:
+    static const int SLAB_SIZE = 256;
+
+    union Slot {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        Slot *next;
+    };
+
+    /**
+     * Allocate a slab and chain its slots into the free list in address order.
+     */
+    void addSlab() {
+        Slot *slab = static_cast<Slot*>(::operator new(SLAB_SIZE * sizeof(Slot)));
+        slabs.push_back(slab);
+
+        for (int i = 0; i < SLAB_SIZE - 1; i++) {
+            slab[i].next = &slab[i + 1];
+        }
+        slab[SLAB_SIZE - 1].next = freeList;
+        freeList = slab;
+
+        stats.slabCount++;
+        stats.capacity += SLAB_SIZE;
+    }
+
+    std::vector<Slot*> slabs;
+    Slot *freeList = nullptr;
+    Stats stats;
+};
+
+/**
+ * Base class that routes new and delete of T through a pool of its own. Allocations of a
+ * different size, i.e. of a class derived from T, fall back to the global heap.
+ */
+template <typename T>
+class Pooled {
+public:
+    static void* operator new(size_t size) {
+        if (size != sizeof(T)) return ::operator new(size);
+        return getPool().acquire();
+    }
+
+    static void operator delete(void *memory, size_t size) {
+        if (memory == nullptr) return;
+        if (size != sizeof(T)) ::operator delete(memory);
+        else getPool().release(memory);
+    }
+
+    static ObjectPool<T> &getPool() {
+        static ObjectPool<T> pool;
+        return pool;
+    }
+};
+
+#endif
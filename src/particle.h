@@ -2,47 +2,60 @@
 #define PARTICLE_H
 
 #include "game_object.h"
+#include "object_pool.h"
+#include "particle_store.h"
 #include "VecMat.h"
 
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
 
-class Particle {
+/**
+ * Handle to a particle simulated by the PhysicsManager. Until the particle is added to a
+ * PhysicsManager its state lives in the handle; afterwards it lives in the ParticleStore.
+ * Handles themselves are allocated from a pool (see Pooled).
+ */
+class Particle: public Pooled<Particle> {
 public:
     Particle(GameObject* owner, int objectId, vec3 position, float mass, float radius, float damping=DEFAULT_DAMPING, bool isForceExempt=false, vec3 velocity=vec3(0,0,0))
-        : owner(owner)
-        , objectId(objectId)
-        , position(position)
+        : position(position)
+        , velocity(velocity)
         , mass(mass)
         , radius(radius)
         , damping(damping)
         , isForceExempt(isForceExempt)
-        , velocity(velocity) { }
+        , objectId(objectId)
+        , owner(owner) { }
+
+    /**
+     * Move the particle's state into the given store. Called by PhysicsManager::addParticle.
+     */
+    void bind(ParticleStore *store) {
+        this->store = store;
+        index = store->add(this, position, velocity, mass, radius, damping, isForceExempt, isContinuous, collisionFilter);
+    }
 
-    void applyForce(vec3 force) {
-        netForce += force;
+    /**
+     * Copy the particle's state back out of its store. Called when the store removes it.
+     */
+    void unbind() {
+        position = store->position[index];
+        velocity = store->velocity[index];
+        mass = store->mass[index];
+        radius = store->radius[index];
+        damping = store->damping[index];
+        isForceExempt = store->isForceExempt[index];
+        isContinuous = store->isContinuous[index];
+        collisionFilter = CollisionFilter(store->collisionLayer[index], store->collisionMask[index], store->collisionGroup[index]);
+        store = nullptr;
+        index = -1;
     }
 
-    void update(double timeDelta) {
-        vec3 acceleration = isForceExempt ? 0.0f : netForce / mass;
-        velocity += acceleration;
-        position += velocity;
-
-        // Collide with the ground
-        if (position.x > -25 && position.x < 25) {
-            if (position.z > -25 && position.z < 25) {
-                if (position.y + radius > -2 && position.y - radius < 0.0f) {
-                    position.y = 0.0 + radius;
-                    velocity.x *= damping;
-                    velocity.y *= -damping;
-                    velocity.z *= damping;
-                }
-            }
-        }
+    void applyForce(vec3 force) {
+        if (store == nullptr) return;
 
-        // Reset net force
-        netForce.x = netForce.y = netForce.z = 0.0f;
+        store->netForce[index] += force;
+        if (dot(force, force) > WAKE_FORCE * WAKE_FORCE) requestWake();
     }
 
     void collideWith(Particle *other) {
@@ -51,47 +64,130 @@ public:
     }
 
     void setPosition(vec3 position) {
-        this->position = position;
+        if (store == nullptr) {
+            this->position = position;
+            return;
+        }
+
+        vec3 delta = position - store->position[index];
+        store->position[index] = position;
+        if (dot(delta, delta) > WAKE_DISTANCE * WAKE_DISTANCE) requestWake();
     }
 
     void setVelocity(vec3 velocity) {
-        this->velocity = velocity;
+        if (store == nullptr) {
+            this->velocity = velocity;
+            return;
+        }
+
+        store->velocity[index] = velocity;
+        requestWake();
     }
 
     void setForceExcemption(bool isForceExempt) {
-        this->isForceExempt = isForceExempt;
+        if (store != nullptr) store->isForceExempt[index] = isForceExempt;
+        else this->isForceExempt = isForceExempt;
+    }
+
+    /**
+     * Sweep the particle along its path every step and stop it at the first particle it hits
+     * (see Narrowphase::sweep), so it cannot pass through thin objects however fast it moves.
+     * Costs a test against every other particle per step, so keep it to a few fast projectiles.
+     */
+    void setContinuous(bool isContinuous) {
+        if (store != nullptr) store->isContinuous[index] = isContinuous;
+        else this->isContinuous = isContinuous;
+    }
+
+    /**
+     * Choose which particles this one collides with. Set when the owner is built; filters are
+     * not part of snapshots.
+     */
+    void setCollisionFilter(const CollisionFilter &filter) {
+        if (store == nullptr) {
+            collisionFilter = filter;
+            return;
+        }
+
+        store->collisionLayer[index] = filter.layer;
+        store->collisionMask[index] = filter.mask;
+        store->collisionGroup[index] = filter.group;
     }
 
     mat4 getXform() {
-        return Translate(position) * Scale(radius, radius, radius);
+        float radius = getRadius();
+        return Translate(getRenderPosition()) * Scale(radius, radius, radius);
     }
 
     bool isInArena() {
-        return position.x >= -25 && position.x <= 25 
-            && position.z >= -25 && position.z <= 25; 
+        vec3 position = getRenderPosition();
+        return position.x >= -25 && position.x <= 25
+            && position.z >= -25 && position.z <= 25;
     }
 
-    vec3 getPosition() { return position; }
-    vec3 getVelocity() { return velocity; }
-    float getRadius() { return radius; }
+    vec3 getPosition() { return store != nullptr ? store->position[index] : position; }
+    vec3 getRenderPosition() { return store != nullptr ? store->getRenderPosition(index) : position; }
+    vec3 getVelocity() { return store != nullptr ? store->velocity[index] : velocity; }
+    float getRadius() { return store != nullptr ? store->radius[index] : radius; }
+    int getIndex() { return index; }
     int getObjectId() { return objectId; }
     GameObject* getOwner() { return owner; }
 
 private:
     static constexpr float DEFAULT_DAMPING = 0.9f;
 
+    // Pushes and moves smaller than these leave a sleeping particle asleep
+    static constexpr float WAKE_FORCE = 0.0001f;
+    static constexpr float WAKE_DISTANCE = 0.0001f;
+
+    void requestWake() {
+        if (!store->asleep[index]) return;
+
+        std::lock_guard<std::mutex> lock(store->wakeMutex);
+        store->wakeRequests.push_back(index);
+    }
+
+    // Initial state, only read while the particle is not in a store
     vec3 position;
     vec3 velocity;
-    vec3 netForce;
     float mass;
     float radius;
     float damping;
-    float frictionStrength;
     bool isForceExempt;
+    bool isContinuous = false;
+    CollisionFilter collisionFilter;
+
+    ParticleStore *store = nullptr;
+    int index = -1;
+
     int objectId;
     GameObject* owner;
 
+    friend class ParticleStore;
 };
 
+inline void ParticleStore::remove(int i) {
+    handles[i]->unbind();
+
+    swapRemove(position, i);
+    swapRemove(previousPosition, i);
+    swapRemove(velocity, i);
+    swapRemove(netForce, i);
+    swapRemove(mass, i);
+    swapRemove(radius, i);
+    swapRemove(damping, i);
+    swapRemove(isForceExempt, i);
+    swapRemove(isContinuous, i);
+    swapRemove(collisionLayer, i);
+    swapRemove(collisionMask, i);
+    swapRemove(collisionGroup, i);
+    swapRemove(asleep, i);
+    swapRemove(island, i);
+    swapRemove(stepLength, i);
+    swapRemove(lodLevel, i);
+    swapRemove(handles, i);
+
+    if (i < size()) handles[i]->index = i;
+}
 
 #endif
@@ -0,0 +1,236 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include "collision_filter.h"
+
+#include "VecMat.h"
+
+#include <mutex>
+#include <vector>
+
+class Particle;
+
+/**
+ * Structure-of-arrays storage for every simulated particle. Particle objects are lightweight
+ * handles that index into these arrays, so the physics passes walk contiguous memory instead
+ * of chasing one heap allocation per particle.
+ */
+class ParticleStore {
+public:
+    ParticleStore() {
+    }
+
+    /**
+     * Append a particle and return its index.
+     */
+    int add(Particle *handle, vec3 position, vec3 velocity, float mass, float radius, float damping, bool isForceExempt, bool isContinuous, const CollisionFilter &filter) {
+        this->position.push_back(position);
+        this->previousPosition.push_back(position);
+        this->velocity.push_back(velocity);
+        this->netForce.push_back(vec3(0, 0, 0));
+        this->mass.push_back(mass);
+        this->radius.push_back(radius);
+        this->damping.push_back(damping);
+        this->isForceExempt.push_back(isForceExempt);
+        this->isContinuous.push_back(isContinuous);
+        this->collisionLayer.push_back(filter.layer);
+        this->collisionMask.push_back(filter.mask);
+        this->collisionGroup.push_back(filter.group);
+        this->asleep.push_back(false);
+        this->island.push_back(-1);
+        this->stepLength.push_back(1.0f);
+        this->lodLevel.push_back(0);
+        this->handles.push_back(handle);
+        return handles.size() - 1;
+    }
+
+    /**
+     * Remove the particle at the given index by moving the last particle into its slot. The
+     * moved particle's handle is updated, so handles stay valid across removals.
+     */
+    void remove(int i);
+
+    /**
+     * Fused pass that applies gravity, integrates velocity and position over each particle's
+     * step length, resolves contact with the arena floor and resets the accumulated force of
+     * every awake particle.
+     */
+    void integrate(float gravityStrength) {
+        int count = size();
+
+        for (int i = 0; i < count; i++) {
+            vec3 force = netForce[i] + vec3(0.0f, -gravityStrength, 0.0f);
+            vec3 acceleration = isForceExempt[i] ? vec3(0.0f, 0.0f, 0.0f) : force / mass[i];
+
+            if (asleep[i]) {
+                netForce[i] = vec3(0.0f, 0.0f, 0.0f);
+                continue;
+            }
+
+            velocity[i] += acceleration * stepLength[i];
+            position[i] += velocity[i] * stepLength[i];
+            collideWithGround(i);
+
+            // Reset net force
+            netForce[i] = vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    /**
+     * Position-based mode, first half: apply gravity and forces to the velocity and move every
+     * awake particle to its predicted position. The positions before the step are kept in
+     * previousPosition.
+     */
+    void predictPositions(float gravityStrength) {
+        int count = size();
+
+        for (int i = 0; i < count; i++) {
+            if (asleep[i]) continue;
+
+            if (!isForceExempt[i]) {
+                vec3 force = netForce[i] + vec3(0.0f, -gravityStrength, 0.0f);
+                velocity[i] += force / mass[i] * stepLength[i];
+            }
+            position[i] += velocity[i] * stepLength[i];
+        }
+    }
+
+    /**
+     * Position-based mode: once constraints have corrected the predicted positions, take each
+     * awake particle's velocity from the distance it travelled this step.
+     */
+    void deriveVelocities() {
+        int count = size();
+
+        for (int i = 0; i < count; i++) {
+            if (!asleep[i]) velocity[i] = (position[i] - previousPosition[i]) / stepLength[i];
+        }
+    }
+
+    /**
+     * Position-based mode, last pass: resolve ground contact and reset forces.
+     */
+    void finishPositionStep() {
+        int count = size();
+
+        for (int i = 0; i < count; i++) {
+            if (!asleep[i]) collideWithGround(i);
+            netForce[i] = vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    /**
+     * Implicit mode, last pass: once the solver has updated the velocities, move every awake
+     * particle over a step of length h times its own step length, resolve ground contact and
+     * reset forces.
+     */
+    void advancePositions(float h) {
+        int count = size();
+
+        for (int i = 0; i < count; i++) {
+            if (!asleep[i]) {
+                position[i] += velocity[i] * (h * stepLength[i]);
+                collideWithGround(i);
+            }
+            netForce[i] = vec3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    /**
+     * Remember the current positions as the start of the step about to run.
+     */
+    void savePreviousPositions() {
+        previousPosition = position;
+    }
+
+    /**
+     * Position blended between the last two steps by renderAlpha, for drawing between steps.
+     */
+    vec3 getRenderPosition(int i) const {
+        return previousPosition[i] + (position[i] - previousPosition[i]) * renderAlpha;
+    }
+
+    int size() const { return handles.size(); }
+
+    /**
+     * Whether the collision filters of particles i and j let them collide (see CollisionFilter).
+     */
+    bool canCollide(int i, int j) const {
+        if (collisionGroup[i] != CollisionFilter::NO_GROUP && collisionGroup[i] == collisionGroup[j]) return false;
+        return (collisionLayer[i] & collisionMask[j]) != 0 && (collisionLayer[j] & collisionMask[i]) != 0;
+    }
+
+    /**
+     * FNV-1a hash over the bits of every position and velocity, in index order.
+     */
+    unsigned long long hash() const {
+        unsigned long long h = 14695981039346656037ull;
+        hashBytes(h, position.data(), position.size() * sizeof(vec3));
+        hashBytes(h, velocity.data(), velocity.size() * sizeof(vec3));
+        return h;
+    }
+
+    std::vector<vec3> position;
+    std::vector<vec3> previousPosition;
+    std::vector<vec3> velocity;
+    std::vector<vec3> netForce;
+    std::vector<float> mass;
+    std::vector<float> radius;
+    std::vector<float> damping;
+    std::vector<unsigned char> isForceExempt;
+    std::vector<unsigned char> isContinuous;
+    std::vector<unsigned int> collisionLayer;
+    std::vector<unsigned int> collisionMask;
+    std::vector<int> collisionGroup;
+    std::vector<unsigned char> asleep;
+    std::vector<int> island;
+    std::vector<Particle*> handles;
+
+    // Length of the current step for each particle, in steps. Always 1 unless PhysicsLod steps
+    // distant islands less often, over longer steps; lodLevel holds their level.
+    std::vector<float> stepLength;
+    std::vector<unsigned char> lodLevel;
+
+    // Sleeping particles that game code touched since the last step. Entities update in
+    // parallel, so requests are added under wakeMutex.
+    std::vector<int> wakeRequests;
+    std::mutex wakeMutex;
+
+    float renderAlpha = 1;
+
+private:
+    void collideWithGround(int i) {
+        vec3 &p = position[i];
+        vec3 &v = velocity[i];
+
+        if (p.x > -ARENA_HALF_SIZE && p.x < ARENA_HALF_SIZE) {
+            if (p.z > -ARENA_HALF_SIZE && p.z < ARENA_HALF_SIZE) {
+                if (p.y + radius[i] > -ARENA_DEPTH && p.y - radius[i] < 0.0f) {
+                    p.y = 0.0 + radius[i];
+                    v.x *= damping[i];
+                    v.y *= -damping[i];
+                    v.z *= damping[i];
+                }
+            }
+        }
+    }
+
+    static void hashBytes(unsigned long long &h, const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char*) data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    static void swapRemove(std::vector<T> &values, int i) {
+        values[i] = values.back();
+        values.pop_back();
+    }
+
+    const float ARENA_HALF_SIZE = 25.0f;
+    const float ARENA_DEPTH = 2.0f;
+};
+
+#endif
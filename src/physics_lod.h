@@ -0,0 +1,323 @@
+#ifndef PHYSICS_LOD_H
+#define PHYSICS_LOD_H
+
+#include "island_manager.h"
+#include "particle_store.h"
+#include "snapshot.h"
+#include "spring.h"
+
+#include "VecMat.h"
+
+#include <math.h>
+#include <vector>
+
+/**
+ * Physics level of detail. Every awake island gets a level from its distance to a focus point,
+ * usually the player, and whether it is inside the camera frustum. Level 0 steps every tick;
+ * level 1 steps every 2nd tick and level 2 every 4th, each step as long as the ticks since the
+ * island's last step, so distant islands keep up with game time. Islands that do not step in a
+ * tick are flagged asleep in the ParticleStore for that tick only, so every physics pass skips
+ * them. Distant islands also stop colliding with each other (see Narrowphase).
+ *
+ * Distance thresholds are widened in the direction of the current level, so an island near a
+ * threshold does not flip between levels. Islands outside the frustum count one level further
+ * away. For the explicit integrator the step length is capped by the stiffest spring of the
+ * island, so coarse levels never step beyond its stability limit.
+ */
+class PhysicsLod {
+public:
+    static const int LEVEL_COUNT = 3;
+
+    PhysicsLod() {
+    }
+
+    /**
+     * Measure distances from focus, and treat islands outside the frustum of viewProjection as
+     * one level further away. Enables level of detail.
+     */
+    void setFocus(vec3 focus, const mat4 &viewProjection) {
+        this->focus = focus;
+        isEnabled = true;
+        isFrustumUsed = true;
+
+        // Frustum planes of a column-vector projection (Gribb and Hartmann), pointing inwards
+        const vec4 &w = viewProjection[3];
+        for (int i = 0; i < 3; i++) {
+            frustum[2 * i] = w + viewProjection[i];
+            frustum[2 * i + 1] = w - viewProjection[i];
+        }
+        for (int p = 0; p < 6; p++) {
+            float normalLength = length(vec3(frustum[p].x, frustum[p].y, frustum[p].z));
+            if (normalLength > 0) frustum[p] = frustum[p] / normalLength;
+        }
+    }
+
+    /**
+     * Measure distances from focus and treat every island as visible.
+     */
+    void setFocus(vec3 focus) {
+        this->focus = focus;
+        isEnabled = true;
+        isFrustumUsed = false;
+    }
+
+    /**
+     * Step every island every tick again.
+     */
+    void disable() {
+        isEnabled = false;
+    }
+
+    /**
+     * Islands nearer than nearDistance are at level 0 and islands beyond farDistance at level
+     * 2. An island only changes level once it is margin past a threshold.
+     */
+    void setDistances(float nearDistance, float farDistance, float margin) {
+        this->nearDistance = nearDistance;
+        this->farDistance = farDistance;
+        this->margin = margin;
+    }
+
+    /**
+     * Called after the islands have been rebuilt. Each island takes the finest level of its
+     * particles, and is assumed to have stepped on its level's schedule so far. Also finds the
+     * coarsest level at which each island's springs stay stable under explicit integration.
+     */
+    void rebuild(ParticleStore &store, const IslandManager &islands, const std::vector<Spring*> &springs) {
+        int islandCount = islands.getIslandCount();
+        const std::vector<int> &particles = islands.getIslandParticles();
+
+        level.resize(islandCount);
+        lastStepTick.resize(islandCount);
+        stepLength.resize(islandCount);
+        for (int k = 0; k < islandCount; k++) {
+            int finest = LEVEL_COUNT - 1;
+            for (int n = islands.getIslandStart(k); n < islands.getIslandStart(k + 1); n++) {
+                if (store.lodLevel[particles[n]] < finest) finest = store.lodLevel[particles[n]];
+            }
+            setLevel(store, islands, k, finest);
+            lastStepTick[k] = lastScheduledTick(finest, tick - 1);
+        }
+
+        stableLevel.assign(islandCount, LEVEL_COUNT - 1);
+        for (int i = 0; i < springs.size(); i++) {
+            int i1 = springs[i]->getParticle1()->getIndex();
+            int i2 = springs[i]->getParticle2()->getIndex();
+            float inverseMass = 1.0f / store.mass[i1] + 1.0f / store.mass[i2];
+            int springLevel = coarsestStableLevel(springs[i]->getStiffness() * inverseMass, springs[i]->getDamping() * inverseMass);
+
+            int k = store.island[i1];
+            if (springLevel < stableLevel[k]) stableLevel[k] = springLevel;
+        }
+    }
+
+    /**
+     * Start a tick: choose each awake island's level, set the step length of the islands that
+     * step and flag the others asleep until endStep. Returns true if any island changed level.
+     */
+    bool beginStep(ParticleStore &store, const IslandManager &islands, bool isStabilityLimited) {
+        const std::vector<int> &particles = islands.getIslandParticles();
+        bool isAnyChanged = false;
+
+        for (int k = 0; k < level.size(); k++) {
+            // Sleeping islands do not move, so they are always up to date. One woken during the
+            // tick steps one tick.
+            if (islands.isIslandAsleep(k)) {
+                lastStepTick[k] = tick;
+                if (stepLength[k] != 1.0f) setLevel(store, islands, k, level[k]);
+                continue;
+            }
+            int newLevel = isEnabled ? chooseLevel(store, islands, k) : 0;
+            if (isStabilityLimited && newLevel > stableLevel[k]) newLevel = stableLevel[k];
+            if (newLevel != level[k]) {
+                setLevel(store, islands, k, newLevel);
+                isAnyChanged = true;
+            }
+
+            int begin = islands.getIslandStart(k);
+            int end = islands.getIslandStart(k + 1);
+
+            if (isStepping(newLevel)) {
+                int maxTicks = 1 << (isStabilityLimited ? stableLevel[k] : LEVEL_COUNT - 1);
+                int ticks = tick - lastStepTick[k];
+                float h = (float) (ticks < maxTicks ? ticks : maxTicks);
+                if (h != stepLength[k]) {
+                    stepLength[k] = h;
+                    for (int n = begin; n < end; n++) {
+                        store.stepLength[particles[n]] = h;
+                    }
+                }
+                lastStepTick[k] = tick;
+            } else {
+                for (int n = begin; n < end; n++) {
+                    store.asleep[particles[n]] = true;
+                    skipped.push_back(particles[n]);
+                }
+            }
+        }
+
+        return isAnyChanged;
+    }
+
+    /**
+     * Finish the tick: wake the islands that skipped it.
+     */
+    void endStep(ParticleStore &store) {
+        for (int i = 0; i < skipped.size(); i++) {
+            store.asleep[skipped[i]] = false;
+        }
+        skipped.clear();
+        tick++;
+    }
+
+    /**
+     * Whether islands of the given level step in the current tick. Levels 1 and 2 step on
+     * different ticks, to spread their work.
+     */
+    bool isStepping(int level) const {
+        return (tick - phase(level)) % (1 << level) == 0;
+    }
+
+    /**
+     * Write when each particle's island last stepped, as an array with one value per particle.
+     * Levels are kept in the ParticleStore. Like the sleep timers, these must be read back
+     * after the islands have been rebuilt.
+     */
+    void saveStepTicks(const ParticleStore &store, SnapshotWriter &writer) const {
+        writer.write(store.size());
+        for (int i = 0; i < store.size(); i++) {
+            writer.write(lastStepTick[store.island[i]]);
+        }
+    }
+
+    bool restoreStepTicks(const ParticleStore &store, SnapshotReader &reader) {
+        int count;
+        if (!reader.read(count) || count != store.size()) return false;
+        for (int i = 0; i < count; i++) {
+            if (!reader.read(lastStepTick[store.island[i]])) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Ticks run so far. Restore it before rebuilding, which schedules islands by it.
+     */
+    int getTick() const { return tick; }
+    void setTick(int tick) { this->tick = tick; }
+
+    /**
+     * Particles held back in the current tick, between beginStep and endStep.
+     */
+    int getSkippedCount() const { return skipped.size(); }
+
+    int getIslandCount(int level) const {
+        int count = 0;
+        for (int k = 0; k < this->level.size(); k++) {
+            if (this->level[k] == level) count++;
+        }
+        return count;
+    }
+
+private:
+    // Fraction of the explicit stability limit a coarse step may use
+    static constexpr float STABILITY_MARGIN = 0.9f;
+
+    static constexpr float DEFAULT_NEAR_DISTANCE = 20.0f;
+    static constexpr float DEFAULT_FAR_DISTANCE = 40.0f;
+    static constexpr float DEFAULT_MARGIN = 3.0f;
+
+    static int phase(int level) { return level == 2 ? 1 : 0; }
+
+    /**
+     * Level of an island from its bounding sphere, widening each threshold in the direction of
+     * the island's current level.
+     */
+    int chooseLevel(const ParticleStore &store, const IslandManager &islands, int k) {
+        const std::vector<int> &particles = islands.getIslandParticles();
+        int begin = islands.getIslandStart(k);
+        int end = islands.getIslandStart(k + 1);
+
+        vec3 center(0.0f, 0.0f, 0.0f);
+        for (int n = begin; n < end; n++) {
+            center += store.position[particles[n]];
+        }
+        center = center / (float) (end - begin);
+
+        float radius = 0;
+        for (int n = begin; n < end; n++) {
+            int i = particles[n];
+            float extent = length(store.position[i] - center) + store.radius[i];
+            if (extent > radius) radius = extent;
+        }
+
+        float distance = length(center - focus) - radius;
+        int current = level[k];
+        int newLevel = 0;
+        if (distance > nearDistance + (current >= 1 ? -margin : margin)) newLevel = 1;
+        if (distance > farDistance + (current >= 2 ? -margin : margin)) newLevel = 2;
+
+        // Count as visible a margin before entering the view, so level changes at the frustum
+        // edge happen off screen
+        if (isFrustumUsed && !isInFrustum(center, radius + margin) && newLevel < LEVEL_COUNT - 1) newLevel++;
+        return newLevel;
+    }
+
+    bool isInFrustum(vec3 center, float radius) const {
+        for (int p = 0; p < 6; p++) {
+            const vec4 &plane = frustum[p];
+            if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) return false;
+        }
+        return true;
+    }
+
+    void setLevel(ParticleStore &store, const IslandManager &islands, int k, int newLevel) {
+        const std::vector<int> &particles = islands.getIslandParticles();
+        level[k] = newLevel;
+        stepLength[k] = 1.0f;
+        for (int n = islands.getIslandStart(k); n < islands.getIslandStart(k + 1); n++) {
+            store.lodLevel[particles[n]] = newLevel;
+            store.stepLength[particles[n]] = 1.0f;
+        }
+    }
+
+    /**
+     * Latest tick up to the given one on which the level steps.
+     */
+    static int lastScheduledTick(int level, int tick) {
+        int stride = 1 << level;
+        int offset = (tick - phase(level)) % stride;
+        if (offset < 0) offset += stride;
+        return tick - offset;
+    }
+
+    /**
+     * Symplectic Euler on a damped spring with stiffness and damping per unit mass k and c is
+     * stable for steps h with h^2 k + 2 h c < 4.
+     */
+    static int coarsestStableLevel(float stiffness, float damping) {
+        int stable = 0;
+        for (int l = 1; l < LEVEL_COUNT; l++) {
+            float h = (float) (1 << l);
+            if (h * h * stiffness + 2 * h * damping < 4 * STABILITY_MARGIN) stable = l;
+        }
+        return stable;
+    }
+
+    bool isEnabled = false;
+    bool isFrustumUsed = false;
+    vec3 focus;
+    vec4 frustum[6];
+
+    float nearDistance = DEFAULT_NEAR_DISTANCE;
+    float farDistance = DEFAULT_FAR_DISTANCE;
+    float margin = DEFAULT_MARGIN;
+
+    int tick = 0;
+    std::vector<unsigned char> level;
+    std::vector<int> lastStepTick;
+    std::vector<float> stepLength;
+    std::vector<unsigned char> stableLevel;
+    std::vector<int> skipped;
+};
+
+#endif
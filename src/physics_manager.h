@@ -1,66 +1,512 @@
 #ifndef PHYSICS_MANAGER_H
 #define PHYSICS_MANAGER_H
 
+#include "broadphase.h"
+#include "contact.h"
+#include "implicit_solver.h"
+#include "island_manager.h"
+#include "job_system.h"
+#include "narrowphase.h"
 #include "particle.h"
+#include "particle_store.h"
+#include "physics_lod.h"
+#include "physics_stats.h"
+#include "snapshot.h"
+#include "spatial_hash.h"
 #include "spring.h"
+#include "spring_solver.h"
+#include "sweep_and_prune.h"
 
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <utility>
 #include <vector>
 
+/**
+ * Particles and springs taken out of the simulation by PhysicsManager::detachOwner, and whether
+ * each was drawn, so PhysicsManager::attach can add them back as they were. Whoever holds the
+ * body owns its particles and springs until then.
+ */
+struct DetachedBody {
+    std::vector<Particle*> particles;
+    std::vector<Spring*> springs;
+    std::vector<bool> isParticleVisible;
+    std::vector<bool> isSpringVisible;
+
+    bool isEmpty() const { return particles.empty() && springs.empty(); }
+
+    /**
+     * Delete the particles and springs.
+     */
+    void clear() {
+        for (int i = 0; i < springs.size(); i++) {
+            delete springs[i];
+        }
+        for (int i = 0; i < particles.size(); i++) {
+            delete particles[i];
+        }
+        particles.clear();
+        springs.clear();
+        isParticleVisible.clear();
+        isSpringVisible.clear();
+    }
+};
+
 class PhysicsManager {
 public:
-    PhysicsManager() {
+    enum Integrator { EXPLICIT, POSITION_BASED, IMPLICIT };
+
+    // Fixed physics rate, see setMaxSubsteps
+    static constexpr float STEPS_PER_SECOND = 60;
+
+    PhysicsManager(Broadphase::Type broadphaseType=Broadphase::SPATIAL_HASH) {
+        if (broadphaseType == Broadphase::SWEEP_AND_PRUNE) broadphase = new SweepAndPrune();
+        else broadphase = new SpatialHashGrid();
+    }
+
+    PhysicsManager(const PhysicsManager&) = delete;
+    PhysicsManager &operator=(const PhysicsManager&) = delete;
+
+    ~PhysicsManager() {
+        delete broadphase;
+
+        for (int i = 0; i < springs.size(); i++) {
+            delete springs[i];
+        }
+        for (int i = 0; i < store.size(); i++) {
+            delete store.handles[i];
+        }
+    }
+
+    /**
+     * Physics runs at STEPS_PER_SECOND, independent of the frame rate. The rate is fixed because
+     * velocities, forces, spring constants and game tuning are all per step: a different rate
+     * would change the game's speed, not only its accuracy. At most maxSubsteps steps run per
+     * frame; time beyond that is dropped so a slow frame cannot snowball.
+     */
+    void setMaxSubsteps(int maxSubsteps) {
+        this->maxSubsteps = maxSubsteps;
+        accumulator = 0;
+    }
+
+    /**
+     * In deterministic mode every frame runs exactly one step of the fixed step time, whatever
+     * the frame time, so a run depends only on the world and the input fed to it each frame.
+     * The physics passes themselves always run in a fixed order with reductions that do not
+     * depend on the worker count, so the same steps on the same world give bit-identical
+     * results; use stateHash() to compare runs.
+     */
+    void setDeterministic(bool isDeterministic) {
+        this->isDeterministic = isDeterministic;
+        accumulator = 0;
+    }
+
+    /**
+     * Hash of every particle's position and velocity, for checking that two runs match.
+     */
+    unsigned long long stateHash() const { return store.hash(); }
+
+    /**
+     * Add a frame's elapsed time to the accumulator and return how many steps to run for it.
+     * Also sets how far between the last two steps getRenderPosition() blends.
+     */
+    int beginFrame(double frameTime) {
+        if (isDeterministic) {
+            store.renderAlpha = 1;
+            return 1;
+        }
+
+        double stepTime = getStepTime();
+        accumulator += frameTime;
+
+        int steps = (int) (accumulator / stepTime);
+        if (steps > maxSubsteps) {
+            steps = maxSubsteps;
+            accumulator = fmod(accumulator, stepTime);
+        } else {
+            accumulator -= steps * stepTime;
+        }
+
+        store.renderAlpha = accumulator / stepTime;
+        return steps;
     }
 
     /**
-     * Update physics objects.
+     * Update physics objects by one step. Velocities are in units per step of getStepTime(), so
+     * pass getStepTime() as timeDelta. Only the implicit integrator takes longer steps, as whole
+     * multiples of getStepTime(); the others always advance one step.
      */
     void update(float timeDelta) {
-        // Collide particles with each other
-        for (int i = 0; i < particles.size(); i++) {
-            Particle *p1 = particles[i];
-
-            for (int j = i + 1; j < particles.size(); j++) {
-                Particle *p2 = particles[j];
-                vec3 delta = p2->getPosition() - p1->getPosition();
-
-                if (length(delta) > 0 && length(delta) < p1->getRadius() + p2->getRadius()) {
-                    float bounceStrength = 0.01f / sqrt(length(delta));
-                    vec3 bounceForce = -delta * bounceStrength;
-                    p1->applyForce(bounceForce);
-                    p2->applyForce(-bounceForce);
-                    p1->collideWith(p2);
-                    p2->collideWith(p1);
-                }
+        Clock::time_point phaseStart = Clock::now();
+        store.savePreviousPositions();
+        updateIslands();
+
+        // Choose the islands that step this tick and how far
+        if (lod.beginStep(store, islands, integrator == EXPLICIT)) areSpringsDirty = true;
+        stepStats.islandsNs = endPhase(phaseStart);
+
+        // Find pairs of particles that may be touching
+        broadphase->findPairs(store, candidatePairs);
+        stepStats.broadphaseNs = endPhase(phaseStart);
+
+        // Collide particles with each other, record the contacts for dispatchContacts() and wake
+        // sleeping islands that were hit
+        narrowphase.collide(store, candidatePairs, contacts, wokenParticles, jobSystem);
+        for (int i = 0; i < wokenParticles.size(); i++) {
+            if (islands.wake(store, store.island[wokenParticles[i]])) areSpringsDirty = true;
+        }
+        stepStats.narrowphaseNs = endPhase(phaseStart);
+
+        // Pack the springs of awake islands, grouped by level
+        if (areSpringsDirty) {
+            awakeSprings.clear();
+            for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+                levelSprings[l].clear();
+            }
+            for (int i = 0; i < springs.size(); i++) {
+                int i1 = springs[i]->getParticle1()->getIndex();
+                if (islands.isIslandAsleep(store.island[i1])) continue;
+                awakeSprings.push_back(springs[i]);
+                levelSprings[store.lodLevel[i1]].push_back(springs[i]);
             }
+            for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+                springSolvers[l].pack(levelSprings[l], store.size());
+            }
+            implicitSolver.pack(awakeSprings);
+            areSpringsDirty = false;
         }
+        stepStats.springsNs = endPhase(phaseStart);
+        stepStats.integrateNs = 0;
 
-        // Apply spring forces to particles
-        for (int i = 0; i < springs.size(); i++) {
-            springs[i]->applyForce();
+        if (integrator == POSITION_BASED) {
+            // Move particles freely, pull them back onto the spring constraints, then update velocities
+            store.predictPositions(GRAVITY_STRENGTH);
+            stepStats.integrateNs += endPhase(phaseStart);
+            for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+                if (lod.isStepping(l)) springSolvers[l].solvePositions(store, constraintIterations, jobSystem);
+            }
+            stepStats.springsNs += endPhase(phaseStart);
+            store.deriveVelocities();
+            stepStats.integrateNs += endPhase(phaseStart);
+            for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+                if (lod.isStepping(l)) springSolvers[l].dampVelocities(store, jobSystem);
+            }
+            stepStats.springsNs += endPhase(phaseStart);
+            store.finishPositionStep();
+        } else if (integrator == IMPLICIT) {
+            // Solve for the velocities at the end of the step, then move particles and collide them
+            // with the ground. The step may span several 60 Hz steps, e.g. one step per frame.
+            float h = timeDelta * STEPS_PER_SECOND;
+            implicitSolver.updateVelocities(store, GRAVITY_STRENGTH, h);
+            stepStats.springsNs += endPhase(phaseStart);
+            store.advancePositions(h);
+        } else {
+            // Apply spring forces, gravity, move particles and collide them with the ground
+            for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+                if (lod.isStepping(l)) springSolvers[l].applyForces(store, jobSystem);
+            }
+            stepStats.springsNs += endPhase(phaseStart);
+            store.integrate(GRAVITY_STRENGTH);
         }
+        stepStats.integrateNs += endPhase(phaseStart);
 
-        // Apply gravity force to particles
-        for (int i = 0; i < particles.size(); i++) {
-            vec3 gravityForce(0.0f, -GRAVITY_STRENGTH, 0.0f);
-            particles[i]->applyForce(gravityForce);
+        // Stop particles flagged for continuous collision where their path first hits another
+        narrowphase.sweep(store, *broadphase, contacts, wokenParticles);
+        for (int i = 0; i < wokenParticles.size(); i++) {
+            if (islands.wake(store, store.island[wokenParticles[i]])) areSpringsDirty = true;
         }
+        stepStats.narrowphaseNs += endPhase(phaseStart);
+        countStep();
+        lod.endStep(store);
 
-        // Move particles
-        for (int i = 0; i < particles.size(); i++) {
-            particles[i]->update(timeDelta);
+        // Put islands that have come to rest to sleep
+        if (sleepSteps > 0 && islands.updateSleep(store, sleepEnergy, sleepSteps)) areSpringsDirty = true;
+        stepStats.islandsNs += endPhase(phaseStart);
+        publishedStats.store(stepStats);
+    }
+
+    /**
+     * Counts and wall-clock phase times of the last update(). Safe to call from any thread,
+     * also while a step is running; it never blocks the physics.
+     */
+    PhysicsStats getStats() const { return publishedStats.load(); }
+
+    /**
+     * Choose how springs are integrated. EXPLICIT applies spring forces and integrates with
+     * symplectic Euler. POSITION_BASED treats springs as compliant distance constraints solved
+     * with the given number of Gauss-Seidel iterations, which stays stable for stiff springs.
+     * IMPLICIT integrates spring forces with backward Euler, solving a sparse linear system every
+     * step; it is unconditionally stable and ignores constraintIterations. It scales each step by
+     * timeDelta, so passing a multiple of getStepTime() to update() takes one longer step; the
+     * game always passes getStepTime().
+     */
+    void setIntegrator(Integrator integrator, int constraintIterations=DEFAULT_CONSTRAINT_ITERATIONS) {
+        this->integrator = integrator;
+        this->constraintIterations = constraintIterations;
+    }
+
+    /**
+     * Let the owners of the particles that touched during the last step react to it. Runs after
+     * update() so game logic never runs in the middle of the physics passes; forces applied here
+     * take effect in the next step. Must run before particles are added or removed.
+     */
+    void dispatchContacts() {
+        for (int i = 0; i < contacts.size(); i++) {
+            Particle *p1 = store.handles[contacts[i].particle1];
+            Particle *p2 = store.handles[contacts[i].particle2];
+            p1->collideWith(p2);
+            p2->collideWith(p1);
         }
     }
 
+    const std::vector<Contact> &getContacts() { return contacts; }
+
+    /**
+     * An island falls asleep after all its particles stayed below the given kinetic energy for
+     * the given number of steps. Zero steps disables sleeping.
+     */
+    void setSleepThreshold(float kineticEnergy, int steps) {
+        sleepEnergy = kineticEnergy;
+        sleepSteps = steps;
+    }
+
+    /**
+     * Step islands far from focus, or outside the frustum of viewProjection, less often; see
+     * PhysicsLod. Call every frame with the player's position and the camera matrix.
+     */
+    void setLodFocus(vec3 focus, const mat4 &viewProjection) {
+        lod.setFocus(focus, viewProjection);
+    }
+
+    /**
+     * Level of detail by distance from focus alone.
+     */
+    void setLodFocus(vec3 focus) {
+        lod.setFocus(focus);
+    }
+
+    void setLodDistances(float nearDistance, float farDistance, float margin) {
+        lod.setDistances(nearDistance, farDistance, margin);
+    }
+
+    void disableLod() {
+        lod.disable();
+    }
+
+    /**
+     * Number of islands at the given level of detail.
+     */
+    int getLodIslandCount(int level) { return lod.getIslandCount(level); }
+
+    /**
+     * Start simulating a particle. The PhysicsManager takes ownership of it; the pointer stays
+     * valid until the particle is removed.
+     */
     void addParticle(Particle *particle, bool isVisible=true) {
-        particles.push_back(particle);
+        particle->bind(&store);
+        broadphase->particleAdded(store.size() - 1);
+        areIslandsDirty = true;
         if (isVisible) visibleParticles.push_back(particle);
     }
 
+    /**
+     * Start simulating a spring. The PhysicsManager takes ownership of it.
+     */
     void addSpring(Spring *spring, bool isVisible=true) {
         springs.push_back(spring);
+        areSpringsDirty = true;
+        areIslandsDirty = true;
         if (isVisible) visibleSprings.push_back(spring);
     }
 
+    /**
+     * Remove and delete a particle together with every spring attached to it. Must not be
+     * called from inside update(), e.g. from a collideWith callback.
+     */
+    void removeParticle(Particle *particle) {
+        removeSpringsIf([particle](Spring *spring) {
+            return spring->getParticle1() == particle || spring->getParticle2() == particle;
+        });
+        removeParticlesIf([particle](Particle *p) { return p == particle; });
+    }
+
+    /**
+     * Remove and delete a spring.
+     */
+    void removeSpring(Spring *spring) {
+        removeSpringsIf([spring](Spring *s) { return s == spring; });
+    }
+
+    /**
+     * Remove and delete every particle owned by the given game object and every spring
+     * attached to those particles.
+     */
+    void removeOwner(GameObject *owner) {
+        removeSpringsIf([owner](Spring *spring) {
+            return spring->getParticle1()->getOwner() == owner || spring->getParticle2()->getOwner() == owner;
+        });
+        removeParticlesIf([owner](Particle *p) { return p->getOwner() == owner; });
+    }
+
+    /**
+     * Take every particle owned by the given game object, and every spring attached to them, out
+     * of the simulation without deleting them, and append them to body. Particle state moves
+     * back into the handles, which keep working while detached. Must not be called from inside
+     * update().
+     */
+    void detachOwner(GameObject *owner, DetachedBody &body) {
+        removeSpringsIf([owner](Spring *spring) {
+            return spring->getParticle1()->getOwner() == owner || spring->getParticle2()->getOwner() == owner;
+        }, &body);
+        removeParticlesIf([owner](Particle *p) { return p->getOwner() == owner; }, &body);
+    }
+
+    /**
+     * Add the particles and springs of a body from detachOwner back into the simulation, in the
+     * order they had before, and empty the body. The PhysicsManager owns them again.
+     */
+    void attach(DetachedBody &body) {
+        for (int i = 0; i < body.particles.size(); i++) {
+            addParticle(body.particles[i], body.isParticleVisible[i]);
+        }
+        for (int i = 0; i < body.springs.size(); i++) {
+            addSpring(body.springs[i], body.isSpringVisible[i]);
+        }
+        body.particles.clear();
+        body.springs.clear();
+        body.isParticleVisible.clear();
+        body.isSpringVisible.clear();
+    }
+
+    /**
+     * Write the whole simulation into buffer as a flat, versioned blob: the state of every
+     * particle, the springs, island sleep timers and levels of detail, pending wake requests,
+     * and the state of every particle owner (see GameObject::saveState). The blob holds no
+     * pointers and can be copied around freely. Saving does not change the simulation, so a
+     * run that saves snapshots plays out exactly like one that does not.
+     */
+    void saveSnapshot(std::vector<unsigned char> &buffer) {
+        buffer.clear();
+        SnapshotWriter writer(buffer);
+        saveSnapshot(writer);
+    }
+
+    void saveSnapshot(SnapshotWriter &writer) {
+        collectOwners();
+
+        writer.write((int) SNAPSHOT_MAGIC);
+        writer.write((int) SNAPSHOT_VERSION);
+
+        // Structure, checked on restore
+        writer.write(store.size());
+        writer.write((int) springs.size());
+        writer.write((int) snapshotOwners.size());
+        writer.writeArray(snapshotOwnerOfParticle);
+        writer.writeArray(snapshotSprings);
+
+        writer.writeArray(store.position);
+        writer.writeArray(store.previousPosition);
+        writer.writeArray(store.velocity);
+        writer.writeArray(store.netForce);
+        writer.writeArray(store.mass);
+        writer.writeArray(store.radius);
+        writer.writeArray(store.damping);
+        writer.writeArray(store.isForceExempt);
+        writer.writeArray(store.isContinuous);
+        writer.writeArray(store.asleep);
+        writer.writeArray(store.lodLevel);
+        writer.write(lod.getTick());
+
+        // Islands out of date since particles or springs changed are rebuilt, with fresh
+        // timers, before the next step; a restore rebuilds them the same way
+        writer.write((int) areIslandsDirty);
+        if (!areIslandsDirty) {
+            islands.saveSleepTimers(store, writer);
+            lod.saveStepTicks(store, writer);
+        }
+        writer.writeArray(store.wakeRequests);
+        writer.write(accumulator);
+
+        for (int i = 0; i < snapshotOwners.size(); i++) {
+            size_t sizePosition = writer.size();
+            writer.write((int) 0);
+            snapshotOwners[i]->saveState(writer);
+            writer.writeAt(sizePosition, (int) (writer.size() - sizePosition - sizeof(int)));
+        }
+    }
+
+    /**
+     * Restore a snapshot taken from this simulation. The snapshot is restored in place, without
+     * allocating beyond room for pending wake requests, so it must have the same structure as the current simulation: the same
+     * particles in the same order, the same springs and the same owners. Returns false and leaves
+     * the simulation untouched if it does not.
+     */
+    bool restoreSnapshot(const std::vector<unsigned char> &buffer) {
+        SnapshotReader reader(buffer);
+        return restoreSnapshot(reader);
+    }
+
+    bool restoreSnapshot(SnapshotReader &reader) {
+        collectOwners();
+
+        size_t start = reader.getPosition();
+        if (!checkSnapshot(reader)) {
+            reader.setPosition(start);
+            return false;
+        }
+        reader.setPosition(start);
+
+        reader.skip(5 * sizeof(int));
+        reader.skip(sizeof(int) + snapshotOwnerOfParticle.size() * sizeof(int));
+        reader.skip(sizeof(int) + snapshotSprings.size() * sizeof(SpringRecord));
+
+        reader.readArray(store.position);
+        reader.readArray(store.previousPosition);
+        reader.readArray(store.velocity);
+        reader.readArray(store.netForce);
+        reader.readArray(store.mass);
+        reader.readArray(store.radius);
+        reader.readArray(store.damping);
+        reader.readArray(store.isForceExempt);
+        reader.readArray(store.isContinuous);
+        reader.readArray(store.asleep);
+        reader.readArray(store.lodLevel);
+        int tick;
+        reader.read(tick);
+        lod.setTick(tick);
+
+        // Regroup islands around the restored sleep state and levels, then restore their timers
+        islands.rebuild(store, springs);
+        lod.rebuild(store, islands, springs);
+        areIslandsDirty = false;
+        int wereIslandsDirty;
+        reader.read(wereIslandsDirty);
+        if (!wereIslandsDirty) {
+            islands.restoreSleepTimers(store, reader);
+            lod.restoreStepTicks(store, reader);
+        }
+
+        int wakeRequestCount;
+        reader.read(wakeRequestCount);
+        store.wakeRequests.resize(wakeRequestCount);
+        for (int i = 0; i < wakeRequestCount; i++) {
+            reader.read(store.wakeRequests[i]);
+        }
+        reader.read(accumulator);
+
+        for (int i = 0; i < snapshotOwners.size(); i++) {
+            reader.skip(sizeof(int));
+            snapshotOwners[i]->restoreState(reader);
+        }
+
+        contacts.clear();
+        broadphase->invalidate();
+        areSpringsDirty = true;
+        return true;
+    }
+
     std::vector<Particle*> *getVisibleParticles() {
         return &visibleParticles;
     }
@@ -69,14 +515,340 @@ public:
         return &visibleSprings;
     }
 
+    /**
+     * Job system that shares the work of each step. Defaults to the shared system of the game.
+     */
+    void setJobSystem(JobSystem *jobSystem) {
+        this->jobSystem = jobSystem;
+    }
+
+    /**
+     * Number of threads, besides the caller, that share the work of each step. Changes the
+     * worker count of the job system itself, so it also applies to everything else using it.
+     */
+    void setWorkerCount(int workerCount) {
+        jobSystem->setWorkerCount(workerCount);
+    }
+
+    double getStepTime() { return 1.0 / STEPS_PER_SECOND; }
+    int getParticleCount() { return store.size(); }
+    int getSpringCount() { return springs.size(); }
+    int getIslandCount() { return islands.getIslandCount(); }
+    int getSleepingIslandCount() { return islands.getSleepingCount(); }
+
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Nanoseconds since phaseStart; restarts the clock for the next phase.
+     */
+    static long long endPhase(Clock::time_point &phaseStart) {
+        Clock::time_point now = Clock::now();
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - phaseStart).count();
+        phaseStart = now;
+        return ns;
+    }
+
+    /**
+     * Fill in the counts of stepStats. Runs before the level of detail unmasks the islands that
+     * skipped the step.
+     */
+    void countStep() {
+        stepStats.step++;
+        stepStats.candidatePairCount = candidatePairs.size();
+        stepStats.contactCount = contacts.size();
+
+        stepStats.springCount = springs.size();
+        stepStats.activeSpringCount = 0;
+        for (int l = 0; l < PhysicsLod::LEVEL_COUNT; l++) {
+            if (lod.isStepping(l)) stepStats.activeSpringCount += levelSprings[l].size();
+        }
+
+        stepStats.sleepingParticleCount = islands.getSleepingParticleCount();
+        stepStats.skippedParticleCount = lod.getSkippedCount();
+        stepStats.activeParticleCount = store.size() - stepStats.sleepingParticleCount - stepStats.skippedParticleCount;
+    }
+
+    /**
+     * Endpoints and constants of a spring as stored in a snapshot.
+     */
+    struct SpringRecord {
+        int particle1, particle2;
+        float targetLength, stiffness, damping;
+    };
+
+    static const int SNAPSHOT_MAGIC = 0x4e525053;  // "SPRN"
+    static const int SNAPSHOT_VERSION = 4;
+
+    /**
+     * Wake islands that game code touched and regroup islands after particles or springs changed.
+     */
+    void updateIslands() {
+        // Rebuild first, so wake requests wake the islands their particles belong to now
+        if (areIslandsDirty) {
+            islands.rebuild(store, springs);
+            lod.rebuild(store, islands, springs);
+            areIslandsDirty = false;
+            areSpringsDirty = true;
+        }
+        if (islands.processWakeRequests(store)) areSpringsDirty = true;
+    }
+
+    /**
+     * List the owners of all particles in order of their first particle, and describe the
+     * current structure the way a snapshot stores it.
+     */
+    void collectOwners() {
+        int count = store.size();
+
+        snapshotOwners.clear();
+        snapshotOwnerIndex.clear();
+        snapshotOwnerOfParticle.resize(count);
+        for (int i = 0; i < count; i++) {
+            GameObject *owner = store.handles[i]->getOwner();
+            if (owner == nullptr) {
+                snapshotOwnerOfParticle[i] = -1;
+                continue;
+            }
+
+            // Pointers are only used for the lookup, never for ordering
+            std::vector<std::pair<GameObject*, int>>::iterator it = std::lower_bound(
+                snapshotOwnerIndex.begin(), snapshotOwnerIndex.end(), std::make_pair(owner, -1));
+            if (it == snapshotOwnerIndex.end() || it->first != owner) {
+                it = snapshotOwnerIndex.insert(it, std::make_pair(owner, (int) snapshotOwners.size()));
+                snapshotOwners.push_back(owner);
+            }
+            snapshotOwnerOfParticle[i] = it->second;
+        }
+
+        snapshotSprings.resize(springs.size());
+        for (int i = 0; i < springs.size(); i++) {
+            SpringRecord &record = snapshotSprings[i];
+            record.particle1 = springs[i]->getParticle1()->getIndex();
+            record.particle2 = springs[i]->getParticle2()->getIndex();
+            record.targetLength = springs[i]->getTargetLength();
+            record.stiffness = springs[i]->getStiffness();
+            record.damping = springs[i]->getDamping();
+        }
+    }
+
+    /**
+     * Check that a snapshot is complete and matches the structure found by collectOwners(),
+     * including the size of every owner's state, before anything is overwritten.
+     */
+    bool checkSnapshot(SnapshotReader &reader) {
+        int magic, version, particleCount, springCount, ownerCount;
+        if (!reader.read(magic) || magic != SNAPSHOT_MAGIC) return false;
+        if (!reader.read(version) || version != SNAPSHOT_VERSION) return false;
+        if (!reader.read(particleCount) || particleCount != store.size()) return false;
+        if (!reader.read(springCount) || springCount != springs.size()) return false;
+        if (!reader.read(ownerCount) || ownerCount != snapshotOwners.size()) return false;
+        if (!matchesArray(reader, snapshotOwnerOfParticle)) return false;
+        if (!matchesArray(reader, snapshotSprings)) return false;
+
+        for (int i = 0; i < 4; i++) {
+            if (!skipArray(reader, particleCount, sizeof(vec3))) return false;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (!skipArray(reader, particleCount, sizeof(float))) return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (!skipArray(reader, particleCount, sizeof(unsigned char))) return false;
+        }
+        int wereIslandsDirty;
+        if (!reader.skip(sizeof(int)) || !reader.read(wereIslandsDirty)) return false;
+        if (!wereIslandsDirty) {
+            if (!skipArray(reader, particleCount, sizeof(int))) return false;
+            if (!skipArray(reader, particleCount, sizeof(int))) return false;
+        }
+
+        int wakeRequestCount;
+        if (!reader.read(wakeRequestCount) || wakeRequestCount < 0) return false;
+        for (int i = 0; i < wakeRequestCount; i++) {
+            int particle;
+            if (!reader.read(particle) || particle < 0 || particle >= particleCount) return false;
+        }
+        if (!reader.skip(sizeof(double))) return false;
+
+        for (int i = 0; i < ownerCount; i++) {
+            snapshotScratch.clear();
+            SnapshotWriter writer(snapshotScratch);
+            snapshotOwners[i]->saveState(writer);
+
+            int size;
+            if (!reader.read(size) || size != snapshotScratch.size() || !reader.skip(size)) return false;
+        }
+        return true;
+    }
+
+    static bool skipArray(SnapshotReader &reader, int expectedCount, size_t elementSize) {
+        int count;
+        return reader.read(count) && count == expectedCount && reader.skip(count * elementSize);
+    }
+
+    template <typename T>
+    static bool matchesArray(SnapshotReader &reader, const std::vector<T> &values) {
+        int count;
+        if (!reader.read(count) || count != values.size()) return false;
+
+        const void *bytes = reader.readBytes(count * sizeof(T));
+        return bytes != nullptr && (count == 0 || memcmp(bytes, values.data(), count * sizeof(T)) == 0);
+    }
+
+    /**
+     * Remove matching springs by moving the last spring into each freed slot. They are deleted,
+     * or appended to detached if given.
+     */
+    template <typename Predicate>
+    void removeSpringsIf(Predicate shouldRemove, DetachedBody *detached=nullptr) {
+        std::vector<Spring*> removed;
+        for (int i = springs.size() - 1; i >= 0; i--) {
+            Spring *spring = springs[i];
+            if (!shouldRemove(spring)) continue;
+
+            springs[i] = springs.back();
+            springs.pop_back();
+            removed.push_back(spring);
+        }
+        if (removed.empty()) return;
+
+        // Found in reverse; detached springs keep their order
+        std::reverse(removed.begin(), removed.end());
+        std::vector<Spring*> sorted = removed;
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<Spring*> removedVisible;
+        compact(visibleSprings, [&](Spring *spring) {
+            if (!std::binary_search(sorted.begin(), sorted.end(), spring)) return false;
+            removedVisible.push_back(spring);
+            return true;
+        });
+
+        if (detached != nullptr) {
+            std::sort(removedVisible.begin(), removedVisible.end());
+            for (int i = 0; i < removed.size(); i++) {
+                detached->springs.push_back(removed[i]);
+                detached->isSpringVisible.push_back(std::binary_search(removedVisible.begin(), removedVisible.end(), removed[i]));
+            }
+        } else {
+            for (int i = 0; i < removed.size(); i++) {
+                delete removed[i];
+            }
+        }
+
+        areSpringsDirty = true;
+        areIslandsDirty = true;
+    }
+
+    /**
+     * Remove matching particles. Springs attached to them must already be removed. They are
+     * deleted, or appended to detached if given.
+     */
+    template <typename Predicate>
+    void removeParticlesIf(Predicate shouldRemove, DetachedBody *detached=nullptr) {
+        // Pending wake requests refer to indices that are about to move
+        islands.processWakeRequests(store);
+
+        std::vector<Particle*> removed;
+        for (int i = store.size() - 1; i >= 0; i--) {
+            Particle *particle = store.handles[i];
+            if (!shouldRemove(particle)) continue;
+
+            store.remove(i);
+            broadphase->particleRemoved(i);
+            removed.push_back(particle);
+        }
+        if (removed.empty()) return;
+
+        std::reverse(removed.begin(), removed.end());
+        std::vector<Particle*> sorted = removed;
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<Particle*> removedVisible;
+        compact(visibleParticles, [&](Particle *particle) {
+            if (!std::binary_search(sorted.begin(), sorted.end(), particle)) return false;
+            removedVisible.push_back(particle);
+            return true;
+        });
+
+        if (detached != nullptr) {
+            std::sort(removedVisible.begin(), removedVisible.end());
+            for (int i = 0; i < removed.size(); i++) {
+                detached->particles.push_back(removed[i]);
+                detached->isParticleVisible.push_back(std::binary_search(removedVisible.begin(), removedVisible.end(), removed[i]));
+            }
+        } else {
+            for (int i = 0; i < removed.size(); i++) {
+                delete removed[i];
+            }
+        }
+
+        // Particles moved to new indices, so packed springs and islands must be rebuilt
+        areSpringsDirty = true;
+        areIslandsDirty = true;
+    }
+
+    /**
+     * Swap-remove every element matching the predicate.
+     */
+    template <typename T, typename Predicate>
+    static void compact(std::vector<T> &values, Predicate shouldRemove) {
+        for (int i = values.size() - 1; i >= 0; i--) {
+            if (shouldRemove(values[i])) {
+                values[i] = values.back();
+                values.pop_back();
+            }
+        }
+    }
+
+    static constexpr int DEFAULT_MAX_SUBSTEPS = 5;
+
+    static constexpr int DEFAULT_CONSTRAINT_ITERATIONS = 4;
+    static constexpr float DEFAULT_SLEEP_ENERGY = 0.0001f;
+    static constexpr int DEFAULT_SLEEP_STEPS = 60;
+
     const float GRAVITY_STRENGTH = 0.005f;
 
-    std::vector<Particle*> particles;
+    Integrator integrator = EXPLICIT;
+    int constraintIterations = DEFAULT_CONSTRAINT_ITERATIONS;
+
+    float sleepEnergy = DEFAULT_SLEEP_ENERGY;
+    int sleepSteps = DEFAULT_SLEEP_STEPS;
+
+    int maxSubsteps = DEFAULT_MAX_SUBSTEPS;
+    double accumulator = 0;
+    bool isDeterministic = false;
+
+    ParticleStore store;
     std::vector<Spring*> springs;
 
     std::vector<Particle*> visibleParticles;
     std::vector<Spring*> visibleSprings;
+
+    JobSystem *jobSystem = &JobSystem::getShared();
+    SpringSolver springSolvers[PhysicsLod::LEVEL_COUNT];
+    std::vector<Spring*> levelSprings[PhysicsLod::LEVEL_COUNT];
+    ImplicitSolver implicitSolver;
+    std::vector<Spring*> awakeSprings;
+    bool areSpringsDirty = false;
+
+    IslandManager islands;
+    bool areIslandsDirty = false;
+    PhysicsLod lod;
+
+    Broadphase *broadphase;
+    std::vector<std::pair<int, int>> candidatePairs;
+    Narrowphase narrowphase;
+    std::vector<Contact> contacts;
+    std::vector<int> wokenParticles;
+
+    PhysicsStats stepStats;
+    SeqLock<PhysicsStats> publishedStats;
+
+    // Scratch space reused by every snapshot
+    std::vector<GameObject*> snapshotOwners;
+    std::vector<std::pair<GameObject*, int>> snapshotOwnerIndex;
+    std::vector<int> snapshotOwnerOfParticle;
+    std::vector<SpringRecord> snapshotSprings;
+    std::vector<unsigned char> snapshotScratch;
 };
 
 #endif
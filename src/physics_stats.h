@@ -0,0 +1,99 @@
+#ifndef PHYSICS_STATS_H
+#define PHYSICS_STATS_H
+
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+/**
+ * What one physics step did and how long each phase took. Spring packing counts towards the
+ * springs phase, and sleep and level of detail bookkeeping towards the islands phase.
+ */
+struct PhysicsStats {
+    // Steps run so far, including this one
+    long long step = 0;
+
+    // Pairs the broadphase found and pairs the narrowphase found touching
+    int candidatePairCount = 0;
+    int contactCount = 0;
+
+    // All springs, and the springs solved this step
+    int springCount = 0;
+    int activeSpringCount = 0;
+
+    // Particles that stepped, that are in sleeping islands and that level of detail held back
+    int activeParticleCount = 0;
+    int sleepingParticleCount = 0;
+    int skippedParticleCount = 0;
+
+    long long islandsNs = 0;
+    long long broadphaseNs = 0;
+    long long narrowphaseNs = 0;
+    long long springsNs = 0;
+    long long integrateNs = 0;
+
+    long long totalNs() const { return islandsNs + broadphaseNs + narrowphaseNs + springsNs + integrateNs; }
+};
+
+/**
+ * Single-writer sequence lock. The writer never blocks; a reader copies the value and retries
+ * if a write overlapped, so readers on any thread see a consistent value without locking. The
+ * value is stored as relaxed atomic words so overlapping reads are not data races.
+ */
+template <typename T>
+class SeqLock {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied bytewise");
+
+    SeqLock()
+        : sequence(0) {
+        store(T());
+    }
+
+    SeqLock(const SeqLock&) = delete;
+    SeqLock &operator=(const SeqLock&) = delete;
+
+    /**
+     * Publish a new value. Only one thread may store.
+     */
+    void store(const T &value) {
+        Word buffer[WORD_COUNT] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        unsigned int begin = sequence.load(std::memory_order_relaxed);
+        sequence.store(begin + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < WORD_COUNT; i++) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(begin + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        Word buffer[WORD_COUNT];
+        while (true) {
+            // An odd sequence means a store is in progress
+            unsigned int begin = sequence.load(std::memory_order_acquire);
+            if (begin & 1) continue;
+
+            for (int i = 0; i < WORD_COUNT; i++) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == begin) break;
+        }
+
+        T value;
+        memcpy(&value, buffer, sizeof(T));
+        return value;
+    }
+
+private:
+    typedef unsigned long long Word;
+    static const int WORD_COUNT = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+    std::atomic<unsigned int> sequence;
+    std::atomic<Word> words[WORD_COUNT];
+};
+
+#endif
@@ -2,38 +2,42 @@
 #define PLAYER_H
 
 #include "bullet.h"
+#include "entity_recycler.h"
 #include "game_object.h"
+#include "object_pool.h"
 #include "particle.h"
 #include "physics_manager.h"
+#include "player_input.h"
 #include "spring.h"
 
 #include "VecMat.h"
 
 #include <typeinfo>
-#include <glad.h>
-#include <GLFW/glfw3.h>
 
 #include "math.h"
 #include <vector>
 
-class Player: public GameObject {
+class Player: public GameObject, public Pooled<Player> {
 public:
-    Player(PhysicsManager *pm, vec3 controllerPosition) {
+    Player(PhysicsManager *pm, EntityStore *entities, vec3 controllerPosition)
+        : GameObject(entities) {
         objectId = PLAYER;
-        color = vec3(0.3f, 0.7f, 0.0f);
-
-        health = MAX_HEALTH;
-        collisionCooldown = MAX_COLLISION_COOLDOWN;
-        isCoolingDown = false;
-        cooldownFlashTimer = 0;
-        isCooldownFlash = false;
+        addVitals(MAX_HEALTH, MAX_COLLISION_COOLDOWN, vec3(0.3f, 0.7f, 0.0f));
 
         // Set up controller
-        this->controllerPosition = controllerPosition;
-        controllerVelocity = vec3(0, 0, 0);
+        Locomotion locomotion = {};
+        locomotion.position = controllerPosition;
+        locomotion.tailPosition = controllerPosition - vec3(0, 0, 1);
+        entities->locomotion.add(entity, locomotion);
+
         lookDirection = vec3(0, 0, 1);
         up = vec3(0, 1, 0);
-        tailPosition = controllerPosition - vec3(0, 0, 1);
+        pitch = 0;
+        yaw = 0;
+        isMoving = false;
+        isOnGround = false;
+        isMousePressed = false;
+        isShooting = false;
         leftFootTarget = controllerPosition + vec3(FOOT_STRADDLE_OFFSET, 0, 0);
         rightFootTarget = controllerPosition + vec3(-FOOT_STRADDLE_OFFSET, 0, 0);
         shouldMoveLeftFoot = true;
@@ -47,6 +51,13 @@ public:
         leftFoot = new Particle(this, objectId, leftFootTarget, 0.1, FOOT_RADIUS);
         rightFoot = new Particle(this, objectId, rightFootTarget, 0.1, FOOT_RADIUS);
 
+        // The player's limbs pass through each other, and through the player's own bullets
+        CollisionFilter filter = collisionFilter(CollisionFilter::PLAYER, CollisionFilter::ALL & ~CollisionFilter::PROJECTILE, false);
+        Particle *particles[] = { base, torso, leftHand, rightHand, leftFoot, rightFoot };
+        for (int i = 0; i < 6; i++) {
+            particles[i]->setCollisionFilter(filter);
+        }
+
         pm->addParticle(base, false);
         pm->addParticle(torso, false);
         pm->addParticle(leftHand);
@@ -62,33 +73,38 @@ public:
         pm->addSpring(new Spring(leftHand, rightHand, 2, 0.01, 0.1), false);
     }
 
-    Bullet* input(GLFWwindow *window, PhysicsManager *pm) {
+    /**
+     * Apply the controls for this step. Returns the bullet fired this step, taken from
+     * bulletRecycler, or nullptr.
+     */
+    Bullet* input(const PlayerInput &controls, EntityRecycler<Bullet> &bulletRecycler) {
         Bullet *bullet = nullptr;
+        vec3 &controllerVelocity = locomotion().velocity;
 
         isMoving = false;
 
-        // Keyboard input for movement
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+        // Movement
+        if (controls.isForward) {
             vec3 forward = normalize(vec3(lookDirection.x, 0, lookDirection.z));
             controllerVelocity += forward * MOVE_FORCE;
             isMoving = true;
         }
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+        if (controls.isBackward) {
             vec3 backward = normalize(-vec3(lookDirection.x, 0, lookDirection.z));
             controllerVelocity += backward * MOVE_FORCE;
             isMoving = true;
         }
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+        if (controls.isLeft) {
             vec3 left = normalize(cross(up, lookDirection));
             controllerVelocity += left * MOVE_FORCE;
             isMoving = true;
         }
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+        if (controls.isRight) {
             vec3 right = normalize(cross(lookDirection, up));
             controllerVelocity += right * MOVE_FORCE;
             isMoving = true;
         }
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+        if (controls.isJumping) {
             if (isOnGround) {
                 controllerVelocity.y = 0.3;
                 base->setVelocity(controllerVelocity);
@@ -97,32 +113,22 @@ public:
             }
         }
 
-        int mouseButtonState = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-        if (mouseButtonState == GLFW_PRESS && !isMousePressed) {
+        if (controls.isFiring && !isMousePressed) {
             isMousePressed = true;
-            vec3 bulletPosition = controllerPosition + vec3(0, 2, 0) + bodyDirection;
+            vec3 bodyDirection = locomotion().bodyDirection;
+            vec3 bulletPosition = locomotion().position + vec3(0, 2, 0) + bodyDirection;
             vec3 bulletVelocity = bodyDirection * 0.4 + vec3(0, 0.02, 0);
-            bullet = new Bullet(bulletPosition, bulletVelocity);
+            bullet = bulletRecycler.spawn(bulletPosition, bulletVelocity);
         }
 
-        if (mouseButtonState == GLFW_RELEASE) {
+        if (!controls.isFiring) {
             isMousePressed = false;
         }
 
-        // Mouse input for look direction
-        double mouseX, mouseY;
-        glfwGetCursorPos(window, &mouseX, &mouseY);
-
-        float xOffset = mouseX - lastMouseX;
-        float yOffset = lastMouseY  - mouseY;
-        lastMouseX = mouseX;
-        lastMouseY = mouseY;
-
+        // Look direction
         float mouseSensitivity = 0.005f;
-        xOffset *= mouseSensitivity;
-        yOffset *= mouseSensitivity;
-        yaw   += xOffset;
-        pitch += yOffset;
+        yaw   += controls.lookX * mouseSensitivity;
+        pitch += controls.lookY * mouseSensitivity;
 
         if (pitch > 0) pitch = 0;
         if (pitch < -1.3) pitch = -1.3;
@@ -138,7 +144,16 @@ public:
         return bullet;
     }
 
-    void update(double timeDelta, void*) override {
+    /**
+     * Move the controller and animate the body. Health and falling off the arena are checked
+     * afterwards, by respawnIfDown.
+     */
+    void update(double timeDelta) {
+        Locomotion &locomotion = this->locomotion();
+        vec3 &controllerPosition = locomotion.position;
+        vec3 &controllerVelocity = locomotion.velocity;
+        const vec3 &bodyDirection = locomotion.bodyDirection;
+
         // Apply gravity
         controllerVelocity += vec3(0, -0.01, 0);
 
@@ -155,17 +170,8 @@ public:
             controllerVelocity.y = yy;
         }
 
-        // Update position
-        controllerPosition += controllerVelocity;
-
-        // Determine body direction from invisible "tail"
-        vec3 delta = controllerPosition - tailPosition;
-        float r = 0.5 / length(delta);
-        tailPosition = controllerPosition - delta * r;
-        delta = normalize(controllerPosition - tailPosition);
-        bodyDirection.x = delta.x;
-        bodyDirection.y = 0;
-        bodyDirection.z = delta.z;
+        // Update position, and body direction from the invisible "tail"
+        locomotion.advance();
 
         // Collide with ground
         bool wasOnGround = isOnGround;
@@ -231,32 +237,22 @@ public:
             leftFoot->setForceExcemption(false);
             rightFoot->setForceExcemption(false);
         }
+    }
 
-        if (isCoolingDown) {
-            color = isCooldownFlash ? vec3(1.0, 0, 0) : vec3(0.3f, 0.7f, 0.0f);
-            cooldownFlashTimer += timeDelta;
-            if (cooldownFlashTimer >= MAX_COOLDOWN_FLASH_TIME) {
-                isCooldownFlash = !isCooldownFlash;
-                cooldownFlashTimer = 0;
-            }
-            collisionCooldown -= timeDelta;
-            if (collisionCooldown <= 0) {
-                isCoolingDown = false;
-                collisionCooldown = MAX_COLLISION_COOLDOWN;
-            }
-        } else {
-            color = vec3(0.3f, 0.7f, 0.0f);
-        }
-
-        if (health <= 0 || controllerPosition.y <= -100)
+    /**
+     * Respawn above the arena after losing all health or falling off. Runs after the cooldown
+     * system, so the respawn cooldown starts counting from the next step.
+     */
+    void respawnIfDown() {
+        if (health().current <= 0 || locomotion().position.y <= -100)
             resetPosition();
-        
-        if (health <= 0)
+
+        if (health().current <= 0)
             resetHealth();
     }
 
     void collideWith(void *thisCollider, void *otherCollider) override {
-        if (isCoolingDown) return;
+        if (cooldown().isActive) return;
 
         Particle *thisParticle = static_cast<Particle*>(thisCollider);
         Particle *otherParticle = static_cast<Particle*>(otherCollider);
@@ -267,29 +263,61 @@ public:
         if (otherObjectId == 1) {
             vec3 responseVelocity = (torso->getPosition() - otherParticle->getPosition()) * 0.05f;
             responseVelocity.y = 0.1f;
-            controllerVelocity = responseVelocity;
+            locomotion().velocity = responseVelocity;
             base->setVelocity(responseVelocity);
             torso->setVelocity(responseVelocity);
             isOnGround = false;
-            health--;
-            isCoolingDown = true;
+            health().current--;
+            cooldown().start();
         }
 
         // Emu collision
         if (otherObjectId == 2) {
             vec3 responseVelocity = (torso->getPosition() - otherParticle->getPosition()) * 0.05f;
             responseVelocity.y = 0.1f;
-            controllerVelocity = responseVelocity;
+            locomotion().velocity = responseVelocity;
             base->setVelocity(responseVelocity);
             torso->setVelocity(responseVelocity);
             isOnGround = false;
-            health--;
-            isCoolingDown = true;
+            health().current--;
+            cooldown().start();
         }
     }
 
+    void saveState(SnapshotWriter &writer) override {
+        GameObject::saveState(writer);
+        writer.write(up);
+        writer.write(pitch);
+        writer.write(yaw);
+        writer.write(lookDirection);
+        writer.write(isMoving);
+        writer.write(isOnGround);
+        writer.write(isMousePressed);
+        writer.write(isShooting);
+        writer.write(leftFootTarget);
+        writer.write(rightFootTarget);
+        writer.write(stride);
+        writer.write(shouldMoveLeftFoot);
+    }
+
+    void restoreState(SnapshotReader &reader) override {
+        GameObject::restoreState(reader);
+        reader.read(up);
+        reader.read(pitch);
+        reader.read(yaw);
+        reader.read(lookDirection);
+        reader.read(isMoving);
+        reader.read(isOnGround);
+        reader.read(isMousePressed);
+        reader.read(isShooting);
+        reader.read(leftFootTarget);
+        reader.read(rightFootTarget);
+        reader.read(stride);
+        reader.read(shouldMoveLeftFoot);
+    }
+
     mat4 getXform() {
-        vec3 z = normalize(bodyDirection);
+        vec3 z = normalize(locomotion().bodyDirection);
         vec3 x = normalize(cross(up, z));
         vec3 y = normalize(cross(z, x));
 
@@ -302,10 +330,11 @@ public:
 
         mat4 t = Transpose(m);
 
-        return Translate(torso->getPosition()) * t * Scale(0.8, 0.8, 0.8);
+        return Translate(torso->getRenderPosition()) * t * Scale(0.8, 0.8, 0.8);
     }
 
     void resetPosition() {
+        vec3 &controllerPosition = locomotion().position;
         controllerPosition = vec3(0, RESET_HEIGHT, 0);
         base->setPosition(controllerPosition);
         torso->setPosition(controllerPosition + vec3(0, HEIGHT+RESET_HEIGHT, 0));
@@ -315,20 +344,20 @@ public:
         rightFootTarget = controllerPosition + vec3(-1,RESET_HEIGHT,0);
         leftFoot->setPosition(leftFootTarget);
         rightFoot->setPosition(rightFootTarget);
-        collisionCooldown = 3;
-        isCoolingDown = true;
+        cooldown().start(RESET_COOLDOWN);
     }
 
     void resetHealth() {
-        health = MAX_HEALTH;
+        health().current = health().max;
     }
 
     ~Player() {
     }
 
-    vec3 getControllerPosition() { return controllerPosition; }
+    vec3 getControllerPosition() { return locomotion().position; }
+    vec3 getRenderPosition() { return base->getRenderPosition(); }
     vec3 getLookDirection() { return lookDirection; }
-    int getHealth() { return health; }
+    int getHealth() { return health().current; }
     bool getIsShooting() { return isShooting; }
 
 private:
@@ -349,20 +378,16 @@ private:
 
     const int MAX_HEALTH = 5;
     const float MAX_COLLISION_COOLDOWN = 1.5;
+    const float RESET_COOLDOWN = 3;
 
     const int RESET_HEIGHT = 15;
 
-    vec3 controllerPosition;
-    vec3 controllerVelocity;
     vec3 up;
     float pitch, yaw;
     vec3 lookDirection;
-    double lastMouseX, lastMouseY;
     bool isMoving, isOnGround, isMousePressed;
     bool isShooting;
 
-    vec3 tailPosition;
-    vec3 bodyDirection;
     vec3 leftFootTarget;
     vec3 rightFootTarget;
     float stride;
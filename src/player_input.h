@@ -0,0 +1,21 @@
+#ifndef PLAYER_INPUT_H
+#define PLAYER_INPUT_H
+
+/**
+ * Controls for the player for one step: read from the keyboard and mouse by Game, or scripted
+ * when the game runs headless.
+ */
+struct PlayerInput {
+    bool isForward = false;
+    bool isBackward = false;
+    bool isLeft = false;
+    bool isRight = false;
+    bool isJumping = false;
+    bool isFiring = false;     // Held down; a bullet is fired when it is first pressed
+
+    // Cursor movement since the previous step, in pixels, positive to the right and up
+    float lookX = 0;
+    float lookY = 0;
+};
+
+#endif
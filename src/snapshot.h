@@ -0,0 +1,121 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Appends plain values and arrays to a flat byte buffer. Values are copied bit for bit in host
+ * byte order, so a snapshot is meant to be read back on the same kind of machine.
+ */
+class SnapshotWriter {
+public:
+    SnapshotWriter(std::vector<unsigned char> &buffer)
+        : buffer(buffer) { }
+
+    template <typename T>
+    void write(const T &value) {
+        writeBytes(&value, sizeof(T));
+    }
+
+    /**
+     * Write the element count followed by the elements.
+     */
+    template <typename T>
+    void writeArray(const std::vector<T> &values) {
+        write((int) values.size());
+        if (!values.empty()) writeBytes(values.data(), values.size() * sizeof(T));
+    }
+
+    /**
+     * Overwrite a value written earlier, e.g. a size that is only known afterwards.
+     */
+    template <typename T>
+    void writeAt(size_t position, const T &value) {
+        memcpy(&buffer[position], &value, sizeof(T));
+    }
+
+    void writeBytes(const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char*) data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    size_t size() const { return buffer.size(); }
+
+private:
+    std::vector<unsigned char> &buffer;
+};
+
+/**
+ * Reads values back from a snapshot written by SnapshotWriter. Reads never allocate: arrays are
+ * copied into vectors that already have the right size. Any read past the end or array of the
+ * wrong size fails and marks the reader invalid.
+ */
+class SnapshotReader {
+public:
+    SnapshotReader(const unsigned char *data, size_t size)
+        : data(data)
+        , size(size) { }
+
+    SnapshotReader(const std::vector<unsigned char> &buffer)
+        : data(buffer.data())
+        , size(buffer.size()) { }
+
+    template <typename T>
+    bool read(T &value) {
+        const void *bytes = readBytes(sizeof(T));
+        if (bytes == nullptr) return false;
+        memcpy((void*) &value, bytes, sizeof(T));
+        return true;
+    }
+
+    /**
+     * Read an array written by SnapshotWriter::writeArray into a vector of the same length.
+     */
+    template <typename T>
+    bool readArray(std::vector<T> &values) {
+        int count;
+        if (!read(count)) return false;
+        if (count != values.size()) return fail();
+
+        const void *bytes = readBytes(count * sizeof(T));
+        if (bytes == nullptr) return false;
+        if (count > 0) memcpy((void*) values.data(), bytes, count * sizeof(T));
+        return true;
+    }
+
+    /**
+     * Return a pointer to the next size bytes and move past them, or nullptr if there are fewer
+     * bytes left.
+     */
+    const void* readBytes(size_t size) {
+        if (!isValid || size > this->size - position) {
+            fail();
+            return nullptr;
+        }
+
+        const unsigned char *bytes = data + position;
+        position += size;
+        return bytes;
+    }
+
+    bool skip(size_t size) { return readBytes(size) != nullptr; }
+
+    size_t getPosition() const { return position; }
+    void setPosition(size_t position) { this->position = position; }
+    bool getIsValid() const { return isValid; }
+
+private:
+    bool fail() {
+        isValid = false;
+        return false;
+    }
+
+    const unsigned char *data;
+    size_t size;
+    size_t position = 0;
+    bool isValid = true;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include "broadphase.h"
+#include "particle_store.h"
+
+#include "VecMat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+/**
+ * Uniform grid broadphase. Particles are bucketed into cubic cells that are hashed into a
+ * table, so only particles in neighbouring cells are considered as collision candidates.
+ */
+class SpatialHashGrid: public Broadphase {
+public:
+    SpatialHashGrid() {
+    }
+
+    /**
+     * Rebuild the grid and collect every candidate pair (i < j) of particles in neighbouring
+     * cells. Pairs are emitted in the same order as a nested i/j loop over all particles.
+     */
+    void findPairs(const ParticleStore &store, std::vector<std::pair<int, int>> &pairs) override {
+        const std::vector<vec3> &positions = store.position;
+        const std::vector<float> &radii = store.radius;
+        pairs.clear();
+
+        int count = positions.size();
+        if (count < 2) return;
+
+        // Any two touching spheres are closer than twice the largest radius
+        maxRadius = 0;
+        for (int i = 0; i < count; i++) {
+            maxRadius = std::max(maxRadius, radii[i]);
+        }
+        cellSize = std::max(2 * maxRadius, MIN_CELL_SIZE);
+
+        buildTable(positions);
+
+        // Visit the 27 cells around each particle and keep the later particles found there
+        std::vector<int> &neighbours = scratchNeighbours;
+        for (int i = 0; i < count; i++) {
+            if (!isHashed[i]) continue;
+
+            neighbours.clear();
+            const Cell &cell = cells[i];
+
+            for (int dx = -1; dx <= 1; dx++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dz = -1; dz <= 1; dz++) {
+                        Cell neighbourCell = { cell.x + dx, cell.y + dy, cell.z + dz };
+                        unsigned int bucket = hashCell(neighbourCell);
+
+                        for (int k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++) {
+                            int j = bucketEntries[k];
+                            if (j > i && cells[j] == neighbourCell && store.canCollide(i, j)) {
+                                neighbours.push_back(j);
+                            }
+                        }
+                    }
+                }
+            }
+
+            std::sort(neighbours.begin(), neighbours.end());
+            for (int k = 0; k < neighbours.size(); k++) {
+                pairs.push_back(std::make_pair(i, neighbours[k]));
+            }
+        }
+    }
+
+    /**
+     * Visit the cells that hold the centres of spheres reaching the box. A box spanning more
+     * cells than there are particles, or with non-finite corners, returns every particle in the
+     * grid instead.
+     */
+    void query(const ParticleStore &store, vec3 lower, vec3 upper, std::vector<int> &particles) override {
+        particles.clear();
+        int count = store.size();
+        if (cells.size() != count) {
+            Broadphase::query(store, lower, upper, particles);
+            return;
+        }
+
+        vec3 reach(maxRadius, maxRadius, maxRadius);
+        vec3 lowerCell = (lower - reach) / cellSize;
+        vec3 upperCell = (upper + reach) / cellSize;
+        double cellCount = 1;
+        for (int a = 0; a < 3; a++) {
+            cellCount *= std::floor(upperCell[a]) - std::floor(lowerCell[a]) + 1.0;
+        }
+
+        if (!(cellCount <= count)) {
+            for (int i = 0; i < count; i++) {
+                if (isHashed[i]) particles.push_back(i);
+            }
+            return;
+        }
+
+        Cell first = { (int) std::floor(lowerCell.x), (int) std::floor(lowerCell.y), (int) std::floor(lowerCell.z) };
+        Cell last = { (int) std::floor(upperCell.x), (int) std::floor(upperCell.y), (int) std::floor(upperCell.z) };
+        for (int x = first.x; x <= last.x; x++) {
+            for (int y = first.y; y <= last.y; y++) {
+                for (int z = first.z; z <= last.z; z++) {
+                    Cell cell = { x, y, z };
+                    unsigned int bucket = hashCell(cell);
+
+                    for (int k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++) {
+                        int j = bucketEntries[k];
+                        if (cells[j] == cell) particles.push_back(j);
+                    }
+                }
+            }
+        }
+        std::sort(particles.begin(), particles.end());
+    }
+
+private:
+    struct Cell {
+        int x, y, z;
+
+        bool operator==(const Cell &other) const {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    const float MIN_CELL_SIZE = 0.001f;
+
+    /**
+     * Counting sort of particle indices by bucket, so each bucket is a contiguous range.
+     */
+    void buildTable(const std::vector<vec3> &positions) {
+        int count = positions.size();
+
+        tableSize = 1;
+        while (tableSize < 2 * count) tableSize <<= 1;
+
+        cells.resize(count);
+        buckets.resize(count);
+        isHashed.assign(count, false);
+        bucketStart.assign(tableSize + 1, 0);
+        bucketEntries.resize(count);
+
+        for (int i = 0; i < count; i++) {
+            const vec3 &p = positions[i];
+
+            // Particles with non-finite positions never pass the sphere test, so leave them out
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+
+            cells[i].x = (int) std::floor(p.x / cellSize);
+            cells[i].y = (int) std::floor(p.y / cellSize);
+            cells[i].z = (int) std::floor(p.z / cellSize);
+            buckets[i] = hashCell(cells[i]);
+            isHashed[i] = true;
+            bucketStart[buckets[i] + 1]++;
+        }
+
+        for (int b = 0; b < tableSize; b++) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+
+        std::vector<int> &fill = scratchFill;
+        fill.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for (int i = 0; i < count; i++) {
+            if (isHashed[i]) bucketEntries[fill[buckets[i]]++] = i;
+        }
+    }
+
+    unsigned int hashCell(const Cell &cell) const {
+        unsigned int h = (unsigned int) cell.x * 73856093u
+                       ^ (unsigned int) cell.y * 19349663u
+                       ^ (unsigned int) cell.z * 83492791u;
+        return h & (tableSize - 1);
+    }
+
+    float cellSize = 1;
+    float maxRadius = 0;
+    unsigned int tableSize = 1;
+
+    std::vector<Cell> cells;
+    std::vector<unsigned int> buckets;
+    std::vector<bool> isHashed;
+    std::vector<int> bucketStart;
+    std::vector<int> bucketEntries;
+
+    std::vector<int> scratchNeighbours;
+    std::vector<int> scratchFill;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef SPRING_SOLVER_H
+#define SPRING_SOLVER_H
+
+#include "job_system.h"
+#include "particle_store.h"
+#include "spring.h"
+
+#include "VecMat.h"
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SPROIN_SPRING_SIMD 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Evaluates all springs as one batch. Endpoint indices and spring constants are packed into
+ * arrays, forces are computed four (SSE) or eight (AVX2) springs at a time into per-spring
+ * outputs, and a scalar pass then scatters them to the particles so no two lanes ever write
+ * the same particle.
+ *
+ * Springs are packed grouped by colour, where no two springs of a colour share a particle.
+ * Each colour can therefore be scattered by several threads at once without atomics, and
+ * every particle sums its spring forces in the same order however the work is split.
+ */
+class SpringSolver {
+public:
+    enum Kernel { SCALAR, SSE, AVX2 };
+
+    // Fewer springs than this are solved on the calling thread
+    static const int PARALLEL_THRESHOLD = 4096;
+
+    SpringSolver() {
+        kernel = detectKernel();
+    }
+
+    /**
+     * Colour the given springs and pack their endpoint indices and constants. Must be called
+     * again whenever springs are added or removed.
+     */
+    void pack(const std::vector<Spring*> &springs, int particleCount) {
+        int count = springs.size();
+        std::vector<int> order;
+        colour(springs, particleCount, order);
+
+        index1.resize(count);
+        index2.resize(count);
+        targetLength.resize(count);
+        stiffness.resize(count);
+        damping.resize(count);
+
+        for (int i = 0; i < count; i++) {
+            Spring *spring = springs[order[i]];
+            index1[i] = spring->getParticle1()->getIndex();
+            index2[i] = spring->getParticle2()->getIndex();
+            targetLength[i] = spring->getTargetLength();
+            stiffness[i] = spring->getStiffness();
+            damping[i] = spring->getDamping();
+        }
+
+        forceX.resize(count);
+        forceY.resize(count);
+        forceZ.resize(count);
+        lambda.resize(count);
+    }
+
+    /**
+     * Apply an elastic force (Hooke's Law) and a damping force to both ends of every packed
+     * spring. The first particle receives the computed force, the second its negation. Large
+     * batches are spread over the job system when one is given.
+     */
+    void applyForces(ParticleStore &store, JobSystem *jobSystem=nullptr) {
+        if (jobSystem == nullptr || jobSystem->getWorkerCount() == 0 || size() < PARALLEL_THRESHOLD) {
+            computeForces(store, 0, size());
+            scatterForces(store, 0, size());
+            return;
+        }
+
+        jobSystem->parallelFor(size(), GRAIN_SIZE, [&](int begin, int end) {
+            computeForces(store, begin, end);
+        });
+
+        forEachColour(jobSystem, [&](int begin, int end) {
+            scatterForces(store, begin, end);
+        });
+    }
+
+    /**
+     * Position-based mode: treat every packed spring as a compliant distance constraint (XPBD)
+     * with compliance 1 / stiffness, and project the particle positions onto the constraints
+     * with the given number of Gauss-Seidel iterations. Springs of one colour share no particle,
+     * so each colour is projected in parallel without changing the result.
+     */
+    void solvePositions(ParticleStore &store, int iterations, JobSystem *jobSystem=nullptr) {
+        std::fill(lambda.begin(), lambda.end(), 0.0f);
+
+        for (int n = 0; n < iterations; n++) {
+            forEachColour(jobSystem, [&](int begin, int end) {
+                projectConstraints(store, begin, end);
+            });
+        }
+    }
+
+    /**
+     * Position-based mode: apply each spring's damping as a velocity change along the spring
+     * pair, once the velocities have been derived from the corrected positions.
+     */
+    void dampVelocities(ParticleStore &store, JobSystem *jobSystem=nullptr) {
+        forEachColour(jobSystem, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int i1 = index1[i], i2 = index2[i];
+                float w1 = inverseMass(store, i1), w2 = inverseMass(store, i2);
+                float amount = damping[i] * (w1 + w2) * store.stepLength[i1];
+                if (amount <= 0) continue;
+                if (amount > 1) amount = 1;
+
+                vec3 relativeVelocity = store.velocity[i2] - store.velocity[i1];
+                vec3 change = relativeVelocity * (amount / (w1 + w2));
+                store.velocity[i1] += change * w1;
+                store.velocity[i2] -= change * w2;
+            }
+        });
+    }
+
+    void computeForces(ParticleStore &store, int begin, int end) {
+        if (begin >= end) return;
+
+        int i = begin;
+#ifdef SPROIN_SPRING_SIMD
+        if (kernel == AVX2) i = computeForcesAvx2(store, begin, end);
+        else if (kernel == SSE) i = computeForcesSse(store, begin, end);
+#endif
+        computeForcesScalar(store, i, end);
+    }
+
+    void scatterForces(ParticleStore &store, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            vec3 force(forceX[i], forceY[i], forceZ[i]);
+            store.netForce[index1[i]] += force;
+            store.netForce[index2[i]] -= force;
+        }
+    }
+
+    void setKernel(Kernel kernel) { this->kernel = kernel; }
+    Kernel getKernel() { return kernel; }
+    int size() { return index1.size(); }
+    int getColourCount() { return colourStart.empty() ? 0 : colourStart.size() - 1; }
+
+    /**
+     * Pick the widest kernel the CPU supports.
+     */
+    static Kernel detectKernel() {
+#ifdef SPROIN_SPRING_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return AVX2;
+        return SSE;
+#else
+        return SCALAR;
+#endif
+    }
+
+private:
+    static const int MAX_COLOURS = 64;
+    static const int GRAIN_SIZE = 1024;
+
+    /**
+     * Run task over the springs of each colour in turn, spreading a colour over the job system
+     * when it is large. Springs beyond the last colour may share particles and run serially.
+     */
+    template <typename Task>
+    void forEachColour(JobSystem *jobSystem, Task task) {
+        if (jobSystem == nullptr || jobSystem->getWorkerCount() == 0 || size() < PARALLEL_THRESHOLD) {
+            task(0, size());
+            return;
+        }
+
+        for (int c = 0; c + 1 < colourStart.size(); c++) {
+            int colourBegin = colourStart[c];
+            int colourEnd = colourStart[c + 1];
+
+            if (c == MAX_COLOURS) {
+                task(colourBegin, colourEnd);
+                continue;
+            }
+
+            jobSystem->parallelFor(colourEnd - colourBegin, GRAIN_SIZE, [&](int begin, int end) {
+                task(colourBegin + begin, colourBegin + end);
+            });
+        }
+    }
+
+    static float inverseMass(const ParticleStore &store, int i) {
+        return store.isForceExempt[i] || store.asleep[i] ? 0.0f : 1.0f / store.mass[i];
+    }
+
+    /**
+     * One XPBD iteration over a range of springs. The scaled compliance is 1 / (stiffness h^2)
+     * for a step of h time units; both ends of a spring share their island's step length.
+     */
+    void projectConstraints(ParticleStore &store, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int i1 = index1[i], i2 = index2[i];
+            float w1 = inverseMass(store, i1), w2 = inverseMass(store, i2);
+            if (stiffness[i] <= 0 || w1 + w2 <= 0) continue;
+            float h = store.stepLength[i1];
+            float compliance = 1.0f / (stiffness[i] * h * h);
+
+            vec3 delta = store.position[i2] - store.position[i1];
+            float length = sqrtf(dot(delta, delta));
+            if (length <= 0) continue;
+
+            float constraint = length - targetLength[i];
+            float deltaLambda = (-constraint - compliance * lambda[i]) / (w1 + w2 + compliance);
+            lambda[i] += deltaLambda;
+
+            vec3 correction = delta * (deltaLambda / length);
+            store.position[i1] -= correction * w1;
+            store.position[i2] += correction * w2;
+        }
+    }
+
+    /**
+     * Greedy edge colouring: each spring takes the lowest colour not yet used at either end.
+     * Springs that find all colours taken go into one extra colour that is scattered serially.
+     * Produces the spring order grouped by colour and the start of each colour in it.
+     */
+    void colour(const std::vector<Spring*> &springs, int particleCount, std::vector<int> &order) {
+        int count = springs.size();
+        std::vector<unsigned long long> usedColours(particleCount, 0);
+        std::vector<int> springColour(count);
+        std::vector<int> colourSize(MAX_COLOURS + 1, 0);
+
+        for (int i = 0; i < count; i++) {
+            int i1 = springs[i]->getParticle1()->getIndex();
+            int i2 = springs[i]->getParticle2()->getIndex();
+            unsigned long long used = usedColours[i1] | usedColours[i2];
+
+            int c = 0;
+            while (c < MAX_COLOURS && (used & (1ull << c))) c++;
+            if (c < MAX_COLOURS) {
+                usedColours[i1] |= 1ull << c;
+                usedColours[i2] |= 1ull << c;
+            }
+
+            springColour[i] = c;
+            colourSize[c]++;
+        }
+
+        int colourCount = MAX_COLOURS + 1;
+        while (colourCount > 0 && colourSize[colourCount - 1] == 0) colourCount--;
+
+        colourStart.assign(colourCount + 1, 0);
+        for (int c = 0; c < colourCount; c++) {
+            colourStart[c + 1] = colourStart[c] + colourSize[c];
+        }
+
+        std::vector<int> fill(colourStart.begin(), colourStart.end() - 1);
+        order.resize(count);
+        for (int i = 0; i < count; i++) {
+            order[fill[springColour[i]]++] = i;
+        }
+    }
+
+    void computeForcesScalar(ParticleStore &store, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const vec3 &p1 = store.position[index1[i]];
+            const vec3 &p2 = store.position[index2[i]];
+            const vec3 &v1 = store.velocity[index1[i]];
+            const vec3 &v2 = store.velocity[index2[i]];
+
+            float dx = p2.x - p1.x, dy = p2.y - p1.y, dz = p2.z - p1.z;
+            float length = sqrtf(dx * dx + dy * dy + dz * dz);
+            float elastic = stiffness[i] * (1.0f - targetLength[i] / length);
+
+            forceX[i] = elastic * dx - damping[i] * (v1.x - v2.x);
+            forceY[i] = elastic * dy - damping[i] * (v1.y - v2.y);
+            forceZ[i] = elastic * dz - damping[i] * (v1.z - v2.z);
+        }
+    }
+
+#ifdef SPROIN_SPRING_SIMD
+    /**
+     * Four springs per iteration. Returns the index of the first spring left for the scalar tail.
+     */
+    int computeForcesSse(ParticleStore &store, int begin, int end) {
+        const float *position = &store.position[0].x;
+        const float *velocity = &store.velocity[0].x;
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        int i = begin;
+        for (; i + 4 <= end; i += 4) {
+            int a0 = 3 * index1[i], a1 = 3 * index1[i + 1], a2 = 3 * index1[i + 2], a3 = 3 * index1[i + 3];
+            int b0 = 3 * index2[i], b1 = 3 * index2[i + 1], b2 = 3 * index2[i + 2], b3 = 3 * index2[i + 3];
+
+            __m128 dx = _mm_sub_ps(
+                _mm_setr_ps(position[b0], position[b1], position[b2], position[b3]),
+                _mm_setr_ps(position[a0], position[a1], position[a2], position[a3]));
+            __m128 dy = _mm_sub_ps(
+                _mm_setr_ps(position[b0 + 1], position[b1 + 1], position[b2 + 1], position[b3 + 1]),
+                _mm_setr_ps(position[a0 + 1], position[a1 + 1], position[a2 + 1], position[a3 + 1]));
+            __m128 dz = _mm_sub_ps(
+                _mm_setr_ps(position[b0 + 2], position[b1 + 2], position[b2 + 2], position[b3 + 2]),
+                _mm_setr_ps(position[a0 + 2], position[a1 + 2], position[a2 + 2], position[a3 + 2]));
+            __m128 rvx = _mm_sub_ps(
+                _mm_setr_ps(velocity[a0], velocity[a1], velocity[a2], velocity[a3]),
+                _mm_setr_ps(velocity[b0], velocity[b1], velocity[b2], velocity[b3]));
+            __m128 rvy = _mm_sub_ps(
+                _mm_setr_ps(velocity[a0 + 1], velocity[a1 + 1], velocity[a2 + 1], velocity[a3 + 1]),
+                _mm_setr_ps(velocity[b0 + 1], velocity[b1 + 1], velocity[b2 + 1], velocity[b3 + 1]));
+            __m128 rvz = _mm_sub_ps(
+                _mm_setr_ps(velocity[a0 + 2], velocity[a1 + 2], velocity[a2 + 2], velocity[a3 + 2]),
+                _mm_setr_ps(velocity[b0 + 2], velocity[b1 + 2], velocity[b2 + 2], velocity[b3 + 2]));
+
+            __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 length = _mm_sqrt_ps(lengthSquared);
+            __m128 k = _mm_loadu_ps(&stiffness[i]);
+            __m128 c = _mm_loadu_ps(&damping[i]);
+            __m128 elastic = _mm_mul_ps(k, _mm_sub_ps(one, _mm_div_ps(_mm_loadu_ps(&targetLength[i]), length)));
+
+            _mm_storeu_ps(&forceX[i], _mm_sub_ps(_mm_mul_ps(elastic, dx), _mm_mul_ps(c, rvx)));
+            _mm_storeu_ps(&forceY[i], _mm_sub_ps(_mm_mul_ps(elastic, dy), _mm_mul_ps(c, rvy)));
+            _mm_storeu_ps(&forceZ[i], _mm_sub_ps(_mm_mul_ps(elastic, dz), _mm_mul_ps(c, rvz)));
+        }
+        return i;
+    }
+
+    /**
+     * Eight springs per iteration, gathering endpoint components straight from the store.
+     */
+    __attribute__((target("avx2")))
+    int computeForcesAvx2(ParticleStore &store, int begin, int end) {
+        const float *position = &store.position[0].x;
+        const float *velocity = &store.velocity[0].x;
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256i three = _mm256_set1_epi32(3);
+
+        int i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256i a = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*) &index1[i]), three);
+            __m256i b = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*) &index2[i]), three);
+
+            __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(position, b, 4), _mm256_i32gather_ps(position, a, 4));
+            __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(position + 1, b, 4), _mm256_i32gather_ps(position + 1, a, 4));
+            __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(position + 2, b, 4), _mm256_i32gather_ps(position + 2, a, 4));
+            __m256 rvx = _mm256_sub_ps(_mm256_i32gather_ps(velocity, a, 4), _mm256_i32gather_ps(velocity, b, 4));
+            __m256 rvy = _mm256_sub_ps(_mm256_i32gather_ps(velocity + 1, a, 4), _mm256_i32gather_ps(velocity + 1, b, 4));
+            __m256 rvz = _mm256_sub_ps(_mm256_i32gather_ps(velocity + 2, a, 4), _mm256_i32gather_ps(velocity + 2, b, 4));
+
+            __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+            __m256 length = _mm256_sqrt_ps(lengthSquared);
+            __m256 k = _mm256_loadu_ps(&stiffness[i]);
+            __m256 c = _mm256_loadu_ps(&damping[i]);
+            __m256 elastic = _mm256_mul_ps(k, _mm256_sub_ps(one, _mm256_div_ps(_mm256_loadu_ps(&targetLength[i]), length)));
+
+            _mm256_storeu_ps(&forceX[i], _mm256_sub_ps(_mm256_mul_ps(elastic, dx), _mm256_mul_ps(c, rvx)));
+            _mm256_storeu_ps(&forceY[i], _mm256_sub_ps(_mm256_mul_ps(elastic, dy), _mm256_mul_ps(c, rvy)));
+            _mm256_storeu_ps(&forceZ[i], _mm256_sub_ps(_mm256_mul_ps(elastic, dz), _mm256_mul_ps(c, rvz)));
+        }
+        return i;
+    }
+#endif
+
+    Kernel kernel;
+
+    std::vector<int> index1, index2;
+    std::vector<float> targetLength;
+    std::vector<float> stiffness;
+    std::vector<float> damping;
+
+    std::vector<float> forceX, forceY, forceZ;
+    std::vector<float> lambda;
+    std::vector<int> colourStart;
+};
+
+#endif
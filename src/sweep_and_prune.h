@@ -0,0 +1,365 @@
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+#include "broadphase.h"
+#include "particle_store.h"
+
+#include "VecMat.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+/**
+ * Incremental sweep-and-prune along one axis. Interval endpoints stay sorted between steps and
+ * are re-sorted by insertion sort, which is close to linear because particles only move a
+ * little each step. Every swap of a start and an end endpoint adds or removes a pair in a
+ * persistent list of pairs whose intervals overlap on the sweep axis, kept sorted per particle
+ * so that pairs come out in nested-loop order without sorting them. Added particles are
+ * inserted by binary search and removed ones are patched out, so spawns and deaths cost little
+ * more than the particles they touch. Dense clusters, where many intervals overlap on the sweep
+ * axis without touching, are better served by the grid.
+ */
+class SweepAndPrune: public Broadphase {
+public:
+    SweepAndPrune() {
+    }
+
+    void findPairs(const ParticleStore &store, std::vector<std::pair<int, int>> &pairs) override {
+        // Sorting in many new particles one by one costs more than sorting everything again
+        if (isDirty || overlaps.size() != store.size() || added.size() * REBUILD_FRACTION > store.size()) {
+            rebuild(store);
+        } else {
+            if (hasDeadEndpoints) compactEndpoints();
+            updateEndpoints(store);
+            insertionSort();
+            if (!added.empty()) insertAdded(store);
+        }
+        added.clear();
+
+        // Keep pairs that also overlap on the other two axes
+        pairs.clear();
+        for (int i = 0; i < overlaps.size(); i++) {
+            const std::vector<int> &others = overlaps[i];
+            for (std::vector<int>::const_iterator it = std::upper_bound(others.begin(), others.end(), i); it != others.end(); ++it) {
+                if (store.canCollide(i, *it) && overlapsOffAxis(store, i, *it)) pairs.push_back(std::make_pair(i, *it));
+            }
+        }
+    }
+
+    void invalidate() override {
+        isDirty = true;
+    }
+
+    /**
+     * Scan the sorted endpoints for intervals that overlap the box on the sweep axis.
+     */
+    void query(const ParticleStore &store, vec3 lower, vec3 upper, std::vector<int> &particles) override {
+        particles.clear();
+        if (isDirty || overlaps.size() != store.size() || !added.empty()) {
+            Broadphase::query(store, lower, upper, particles);
+            return;
+        }
+        if (areSlotsStale) findSlots();
+
+        std::vector<Endpoint>::const_iterator first = std::lower_bound(endpoints.begin(), endpoints.end(), lower[axis] - 4 * maxRadius, isBefore);
+        std::vector<Endpoint>::const_iterator last = std::upper_bound(endpoints.begin(), endpoints.end(), upper[axis], isAfter);
+        for (std::vector<Endpoint>::const_iterator it = first; it != last; ++it) {
+            if (it->isMin && endpoints[endSlot[it->particle]].value >= lower[axis]) particles.push_back(it->particle);
+        }
+        std::sort(particles.begin(), particles.end());
+    }
+
+    /**
+     * The particle is sorted in at the next step, once the endpoints are up to date. Until then
+     * it has no endpoints, so its slots are -1.
+     */
+    void particleAdded(int i) override {
+        if (isDirty) return;
+        if (i != overlaps.size()) {
+            isDirty = true;
+            return;
+        }
+
+        overlaps.push_back(std::vector<int>());
+        startSlot.push_back(-1);
+        endSlot.push_back(-1);
+        added.push_back(i);
+    }
+
+    /**
+     * Drop the particle's overlaps and mark its endpoints for removal at the next step, then
+     * renumber the last particle, which the store moved into index i.
+     */
+    void particleRemoved(int i) override {
+        if (isDirty) return;
+        int last = overlaps.size() - 1;
+        if (areSlotsStale) findSlots();
+
+        // Particles added since the last step have no endpoints or overlaps yet
+        std::vector<int>::iterator pending = std::find(added.begin(), added.end(), i);
+        if (pending != added.end()) {
+            added.erase(pending);
+        } else {
+            const std::vector<int> &removed = overlaps[i];
+            for (int k = 0; k < removed.size(); k++) {
+                eraseSorted(overlaps[removed[k]], i);
+            }
+            endpoints[startSlot[i]].particle = -1;
+            endpoints[endSlot[i]].particle = -1;
+            hasDeadEndpoints = true;
+        }
+
+        if (i != last) {
+            pending = std::find(added.begin(), added.end(), last);
+            if (pending != added.end()) {
+                *pending = i;
+            } else {
+                endpoints[startSlot[last]].particle = i;
+                endpoints[endSlot[last]].particle = i;
+            }
+            startSlot[i] = startSlot[last];
+            endSlot[i] = endSlot[last];
+
+            const std::vector<int> &moved = overlaps[last];
+            for (int k = 0; k < moved.size(); k++) {
+                eraseSorted(overlaps[moved[k]], last);
+                insertSorted(overlaps[moved[k]], i);
+            }
+            overlaps[i].swap(overlaps[last]);
+        }
+        overlaps.pop_back();
+        startSlot.pop_back();
+        endSlot.pop_back();
+    }
+
+private:
+    // Rebuild when more than 1/REBUILD_FRACTION of the particles were added since the last step
+    static const int REBUILD_FRACTION = 8;
+
+    struct Endpoint {
+        float value;
+        int particle;       // -1 once the particle is removed
+        bool isMin;
+    };
+
+    /**
+     * Pick the axis with the widest spread of particles, sort all endpoints from scratch and
+     * sweep once to find the overlapping intervals.
+     */
+    void rebuild(const ParticleStore &store) {
+        int count = store.size();
+        chooseAxis(store);
+
+        endpoints.resize(2 * count);
+        for (int i = 0; i < count; i++) {
+            endpoints[2 * i].particle = i;
+            endpoints[2 * i].isMin = true;
+            endpoints[2 * i + 1].particle = i;
+            endpoints[2 * i + 1].isMin = false;
+        }
+        updateEndpoints(store);
+        std::sort(endpoints.begin(), endpoints.end(), [](const Endpoint &a, const Endpoint &b) {
+            return a.value < b.value || (a.value == b.value && a.isMin && !b.isMin);
+        });
+
+        overlaps.assign(count, std::vector<int>());
+        std::vector<int> active;
+        std::vector<int> activeSlot(count, -1);
+        for (int k = 0; k < endpoints.size(); k++) {
+            const Endpoint &e = endpoints[k];
+            if (e.isMin) {
+                for (int a = 0; a < active.size(); a++) {
+                    overlaps[e.particle].push_back(active[a]);
+                    overlaps[active[a]].push_back(e.particle);
+                }
+                activeSlot[e.particle] = active.size();
+                active.push_back(e.particle);
+            } else {
+                int slot = activeSlot[e.particle];
+                active[slot] = active.back();
+                activeSlot[active[slot]] = slot;
+                active.pop_back();
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            std::sort(overlaps[i].begin(), overlaps[i].end());
+        }
+
+        isDirty = false;
+        hasDeadEndpoints = false;
+        areSlotsStale = true;
+    }
+
+    void chooseAxis(const ParticleStore &store) {
+        int count = store.size();
+        vec3 mean(0, 0, 0), meanSquare(0, 0, 0);
+        for (int i = 0; i < count; i++) {
+            const vec3 &p = store.position[i];
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+            mean += p;
+            meanSquare += p * p;
+        }
+
+        axis = 0;
+        if (count == 0) return;
+        vec3 variance = meanSquare / count - (mean / count) * (mean / count);
+        if (variance.y > variance[axis]) axis = 1;
+        if (variance.z > variance[axis]) axis = 2;
+    }
+
+    void updateEndpoints(const ParticleStore &store) {
+        maxRadius = 0;
+        for (int k = 0; k < endpoints.size(); k++) {
+            setValue(store, endpoints[k]);
+            maxRadius = std::max(maxRadius, store.radius[endpoints[k].particle]);
+        }
+    }
+
+    void setValue(const ParticleStore &store, Endpoint &e) const {
+        float center = store.position[e.particle][axis];
+        float radius = store.radius[e.particle];
+
+        // Keep non-finite positions at the far end so they cannot break the sort
+        if (!std::isfinite(center)) e.value = FLT_MAX;
+        else e.value = e.isMin ? center - radius : center + radius;
+    }
+
+    static bool isBefore(const Endpoint &e, float value) {
+        return e.value < value;
+    }
+
+    static bool isAfter(float value, const Endpoint &e) {
+        return value < e.value;
+    }
+
+    /**
+     * Re-sort the endpoints. A start moving left past an end begins an overlap, and an end
+     * moving left past a start ends one.
+     */
+    void insertionSort() {
+        for (int k = 1; k < endpoints.size(); k++) {
+            Endpoint e = endpoints[k];
+            int n = k - 1;
+
+            while (n >= 0 && endpoints[n].value > e.value) {
+                const Endpoint &other = endpoints[n];
+                if (e.isMin && !other.isMin) {
+                    insertSorted(overlaps[e.particle], other.particle);
+                    insertSorted(overlaps[other.particle], e.particle);
+                } else if (!e.isMin && other.isMin) {
+                    eraseSorted(overlaps[e.particle], other.particle);
+                    eraseSorted(overlaps[other.particle], e.particle);
+                }
+                endpoints[n + 1] = endpoints[n];
+                n--;
+            }
+            endpoints[n + 1] = e;
+        }
+        areSlotsStale = true;
+    }
+
+    /**
+     * Insert the endpoints of particles added since the last step at their sorted positions,
+     * each start before and each end after any equal value, and add the overlaps that order
+     * implies. Only intervals starting within twice the largest particle diameter before the new
+     * start can reach it; the second diameter covers rounding in the endpoints.
+     */
+    void insertAdded(const ParticleStore &store) {
+        for (int n = 0; n < added.size(); n++) {
+            maxRadius = std::max(maxRadius, store.radius[added[n]]);
+        }
+
+        for (int n = 0; n < added.size(); n++) {
+            int i = added[n];
+            Endpoint start = { 0, i, true };
+            Endpoint end = { 0, i, false };
+            setValue(store, start);
+            setValue(store, end);
+
+            std::vector<Endpoint>::iterator first = std::lower_bound(endpoints.begin(), endpoints.end(), start.value - 4 * maxRadius, isBefore);
+            std::vector<Endpoint>::iterator last = std::upper_bound(endpoints.begin(), endpoints.end(), end.value, isAfter);
+            for (std::vector<Endpoint>::iterator it = first; it != last; ++it) {
+                if (!it->isMin) continue;
+                Endpoint otherEnd = { 0, it->particle, false };
+                setValue(store, otherEnd);
+                if (otherEnd.value >= start.value) {
+                    insertSorted(overlaps[i], it->particle);
+                    insertSorted(overlaps[it->particle], i);
+                }
+            }
+
+            endpoints.insert(std::lower_bound(endpoints.begin(), endpoints.end(), start.value, isBefore), start);
+            endpoints.insert(std::upper_bound(endpoints.begin(), endpoints.end(), end.value, isAfter), end);
+        }
+        areSlotsStale = true;
+    }
+
+    /**
+     * Drop the endpoints of removed particles. The order of the rest, and so their overlaps,
+     * is unchanged.
+     */
+    void compactEndpoints() {
+        endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(), [](const Endpoint &e) {
+            return e.particle < 0;
+        }), endpoints.end());
+        hasDeadEndpoints = false;
+        areSlotsStale = true;
+    }
+
+    /**
+     * Find where each particle's endpoints are, so removals need not search for them.
+     */
+    void findSlots() {
+        startSlot.assign(overlaps.size(), -1);
+        endSlot.assign(overlaps.size(), -1);
+        for (int k = 0; k < endpoints.size(); k++) {
+            const Endpoint &e = endpoints[k];
+            if (e.particle < 0) continue;
+            if (e.isMin) startSlot[e.particle] = k;
+            else endSlot[e.particle] = k;
+        }
+        areSlotsStale = false;
+    }
+
+    bool overlapsOffAxis(const ParticleStore &store, int i, int j) const {
+        float reach = store.radius[i] + store.radius[j];
+        for (int a = 0; a < 3; a++) {
+            if (a == axis) continue;
+            if (!(fabs(store.position[i][a] - store.position[j][a]) <= reach)) return false;
+        }
+        return true;
+    }
+
+    static void insertSorted(std::vector<int> &values, int value) {
+        std::vector<int>::iterator it = std::lower_bound(values.begin(), values.end(), value);
+        if (it == values.end() || *it != value) values.insert(it, value);
+    }
+
+    static void eraseSorted(std::vector<int> &values, int value) {
+        std::vector<int>::iterator it = std::lower_bound(values.begin(), values.end(), value);
+        if (it != values.end() && *it == value) values.erase(it);
+    }
+
+    int axis = 0;
+    float maxRadius = 0;
+    bool isDirty = true;
+    bool hasDeadEndpoints = false;
+    bool areSlotsStale = true;
+    std::vector<Endpoint> endpoints;
+
+    // Particles added since the last step, not yet in endpoints
+    std::vector<int> added;
+
+    // Particles whose intervals overlap on the sweep axis, sorted, for each particle
+    std::vector<std::vector<int>> overlaps;
+
+    // Index in endpoints of each particle's start and end, -1 until it has endpoints; sized like
+    // overlaps, but only valid unless areSlotsStale
+    std::vector<int> startSlot;
+    std::vector<int> endSlot;
+};
+
+#endif